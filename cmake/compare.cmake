@@ -0,0 +1,31 @@
+# Runs COMMAND with the arguments after --, and with the file INPUT as standard input
+# if given, and fails unless what it prints matches the file EXPECTED. With RESULT,
+# the bytes the command writes there are compared instead, as hex; EXPECTED may wrap
+# the digits.
+cmake_minimum_required(VERSION 3.13)
+
+set(ARGS)
+set(after OFF)
+math(EXPR last "${CMAKE_ARGC} - 1")
+foreach(k RANGE ${last})
+	if(after)
+		list(APPEND ARGS "${CMAKE_ARGV${k}}")
+	elseif(CMAKE_ARGV${k} STREQUAL "--")
+		set(after ON)
+	endif()
+endforeach()
+if(DEFINED INPUT)
+	set(input INPUT_FILE ${INPUT})
+endif()
+execute_process(COMMAND ${COMMAND} ${ARGS} ${input} OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "${COMMAND} failed: ${result}\n${output}")
+endif()
+file(READ ${EXPECTED} expected)
+if(DEFINED RESULT)
+	file(READ ${RESULT} output HEX)
+	string(REGEX REPLACE "[ \t\r\n]" "" expected "${expected}")
+endif()
+if(NOT output STREQUAL expected)
+	message(FATAL_ERROR "The output differs from ${EXPECTED}:\n${output}")
+endif()
@@ -0,0 +1,22 @@
+# Feeds the calculator SCALC a long stream of new names, as JSON requests, and checks
+# that names the session no longer holds are reclaimed rather than filling the symbol
+# table: a new name at the end is still just undefined, and a kept one still works.
+cmake_minimum_required(VERSION 3.13)
+
+# 66000 names, written 1000 at a time.
+file(WRITE ${INPUT} "{\"expr\":\"known = 1\"}\n")
+foreach(block RANGE 65)
+	set(requests "")
+	foreach(k RANGE 999)
+		string(APPEND requests "{\"expr\":\"name${block}_${k}\"}\n")
+	endforeach()
+	file(APPEND ${INPUT} "${requests}")
+endforeach()
+file(APPEND ${INPUT} "{\"id\":\"new\",\"expr\":\"other + 1\"}\n{\"id\":\"known\",\"expr\":\"known + sin(0)\"}\n")
+execute_process(COMMAND ${SCALC} --jsonl INPUT_FILE ${INPUT} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "${SCALC} failed: ${result}")
+endif()
+if(NOT output MATCHES "{\"id\":\"new\",\"error\":\"Undefined variable: other\",\"column\":1}\n{\"id\":\"known\",\"value\":1}\n$")
+	message(FATAL_ERROR "New names are rejected after a long stream")
+endif()
@@ -0,0 +1,40 @@
+# Runs the calculator SCALC over each of WORKLOADS, feeding the file as interactive
+# input. With TIMED, reports the time each one takes. With PROFILE_DIR, the runs
+# are the training for profile-guided optimization; Clang's raw profiles are then
+# merged into the default.profdata that the USE build reads.
+cmake_minimum_required(VERSION 3.13)
+
+# Microseconds since the epoch; CMake before 3.23 only has whole seconds.
+if(CMAKE_VERSION VERSION_LESS 3.23)
+	set(clock "%s000000")
+else()
+	set(clock "%s%f")
+endif()
+
+foreach(workload IN LISTS WORKLOADS)
+	get_filename_component(name ${workload} NAME)
+	string(TIMESTAMP start "${clock}")
+	execute_process(COMMAND ${SCALC} INPUT_FILE ${workload} OUTPUT_QUIET ERROR_VARIABLE errors RESULT_VARIABLE result)
+	string(TIMESTAMP stop "${clock}")
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${name} failed: ${result}")
+	endif()
+	if(errors)
+		message(WARNING "${name}: ${errors}")
+	endif()
+	if(TIMED)
+		math(EXPR elapsed "(${stop} - ${start}) / 1000")
+		message(STATUS "${name}: ${elapsed} ms")
+	endif()
+endforeach()
+
+if(PROFILE_DIR AND COMPILER MATCHES "Clang")
+	if(NOT LLVM_PROFDATA)
+		message(FATAL_ERROR "llvm-profdata is needed to merge Clang profiles")
+	endif()
+	file(GLOB raw ${PROFILE_DIR}/*.profraw)
+	execute_process(COMMAND ${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/default.profdata ${raw} RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "llvm-profdata failed: ${result}")
+	endif()
+endif()
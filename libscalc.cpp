@@ -0,0 +1,171 @@
+#include "scalc.hpp"
+#include "libscalc.h"
+
+// Variables are the names the expression and its stages use. Without stages they are
+// the program's globals in order.
+struct scalc_expr {
+	Program program;
+	std::vector<Symbol> names;
+};
+
+// bindings[k] is where the value of names[k] lives, nullptr until it is bound.
+struct scalc_context {
+	const scalc_expr &expr;
+	std::vector<double *> bindings;
+	std::vector<double> locals; // assigned variables that are not bound
+	unsigned threads = 0;
+	std::string error;
+	explicit scalc_context(const scalc_expr &e)
+		: expr(e), bindings(e.names.size(), nullptr), locals(e.program.globals.size(), NAN) {}
+};
+
+static void requireBound(const scalc_context &context) {
+	auto &program = context.expr.program;
+	for(size_t k = 0; k < program.globals.size(); k++) {
+		if(not context.bindings[k] && not program.assigned[k]) throw std::runtime_error("Undefined variable: " + program.globals[k].name());
+	}
+}
+
+// Programs with stages go through the variable table the calculator uses, since a
+// stage evaluates its arguments as programs of their own.
+static double run(scalc_context &context) {
+	static thread_local Machine<double> machine;
+	auto &expr = context.expr;
+	auto &program = expr.program;
+	if(program.stages.empty()) {
+		requireBound(context);
+		std::vector<double *> globals(context.bindings);
+		for(size_t k = 0; k < globals.size(); k++) {
+			if(not globals[k]) globals[k] = &context.locals[k];
+		}
+		return machine.run(program, globals.data());
+	}
+	Variables<double> variables;
+	for(size_t k = 0; k < expr.names.size(); k++) {
+		if(context.bindings[k]) variables[expr.names[k]] = *context.bindings[k];
+	}
+	Value<double> value = evaluate(program, variables);
+	if(value.array) throw std::runtime_error("Expression gives an array");
+	for(size_t k = 0; k < expr.names.size(); k++) {
+		auto it = variables.find(expr.names[k]);
+		if(context.bindings[k] && it != variables.end()) *context.bindings[k] = it->second;
+	}
+	return value.scalar;
+}
+
+// Every variable becomes a column of n elements: the bound array, or a buffer of its
+// own for an assigned one that is not bound.
+static void run(scalc_context &context, size_t n, double *results) {
+	auto &program = context.expr.program;
+	if(not program.stages.empty()) {
+		auto bases = context.bindings;
+		try {
+			for(size_t e = 0; e < n; e++) {
+				for(size_t k = 0; k < bases.size(); k++) {
+					if(bases[k]) context.bindings[k] = bases[k] + e;
+				}
+				results[e] = run(context);
+			}
+		}
+		catch(...) {
+			context.bindings = bases;
+			throw;
+		}
+		context.bindings = bases;
+		return;
+	}
+	requireBound(context);
+	size_t count = program.globals.size();
+	std::vector<Column<double>> columns(count);
+	std::vector<std::vector<double>> buffers(count);
+	std::vector<double *> globals(count, nullptr);
+	for(size_t k = 0; k < count; k++) {
+		if(not context.bindings[k]) buffers[k].assign(n, NAN);
+		columns[k].data = context.bindings[k] ? context.bindings[k] : buffers[k].data();
+		columns[k].size = n;
+	}
+	sweep(program, columns.data(), globals.data(), n, results, context.threads);
+}
+
+scalc_expr *scalc_compile(const char *source, char *error, size_t size) {
+	static const Functions functions;
+	Failure failure;
+	try {
+		std::unique_ptr<scalc_expr> expr(new scalc_expr);
+		Parser parser(source);
+		ASTNode *node = parser.parse();
+		failure = parser.failure;
+		if(not failure) {
+			Compiler compiler(expr->program, functions);
+			node->compile(compiler);
+			failure = compiler.failure;
+		}
+		if(not failure) {
+			expr->names = references(expr->program);
+			return expr.release();
+		}
+	}
+	catch(const std::exception &e) {
+		failure = Failure{ e.what() };
+	}
+	if(error && size) std::snprintf(error, size, "%s", failure.describe().c_str());
+	return nullptr;
+}
+
+void scalc_free(scalc_expr *expr) {
+	delete expr;
+}
+
+scalc_context *scalc_context_new(const scalc_expr *expr) {
+	try {
+		return new scalc_context(*expr);
+	}
+	catch(const std::bad_alloc &) {
+		return nullptr;
+	}
+}
+
+void scalc_context_free(scalc_context *context) {
+	delete context;
+}
+
+// Compares the text, so binding takes no lock on the symbol table.
+int scalc_bind(scalc_context *context, const char *name, double *value) {
+	auto &names = context->expr.names;
+	auto it = std::find_if(names.begin(), names.end(), [&](Symbol symbol) { return symbol.name() == name; });
+	if(it == names.end()) return 0;
+	context->bindings[it - names.begin()] = value;
+	return 1;
+}
+
+void scalc_threads(scalc_context *context, unsigned threads) {
+	context->threads = threads;
+}
+
+double scalc_eval(scalc_context *context) {
+	try {
+		double value = run(*context);
+		context->error.clear();
+		return value;
+	}
+	catch(const std::exception &e) {
+		context->error = e.what();
+		return NAN;
+	}
+}
+
+int scalc_eval_batch(scalc_context *context, size_t n, double *results) {
+	try {
+		run(*context, n, results);
+		context->error.clear();
+		return 0;
+	}
+	catch(const std::exception &e) {
+		context->error = e.what();
+		return -1;
+	}
+}
+
+const char *scalc_error(const scalc_context *context) {
+	return context->error.empty() ? nullptr : context->error.c_str();
+}
@@ -0,0 +1,111 @@
+// libscalc: compiles scalc expressions once and evaluates them in double precision
+// against the caller's variables, without a process or text I/O in between.
+#ifndef LIBSCALC_H
+#define LIBSCALC_H
+
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define SCALC_API __attribute__((visibility("default")))
+#else
+#define SCALC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A compiled expression. It never changes after scalc_compile, so any number of
+// threads can evaluate it at once, each through a context of its own.
+typedef struct scalc_expr scalc_expr;
+
+// The bindings, limits and error state for evaluating one expression. A context is
+// used by one thread at a time, and its expression must outlive it.
+typedef struct scalc_context scalc_context;
+
+// Compiles one expression. On failure returns NULL and, unless error is NULL, writes
+// the message to error, cut to size bytes.
+SCALC_API scalc_expr *scalc_compile(const char *source, char *error, size_t size);
+
+SCALC_API void scalc_free(scalc_expr *expr);
+
+// Returns NULL when out of memory.
+SCALC_API scalc_context *scalc_context_new(const scalc_expr *expr);
+
+SCALC_API void scalc_context_free(scalc_context *context);
+
+// Makes the variable name read from, and assignments to it write to, *value. Returns
+// 1 if the expression uses name, otherwise 0.
+SCALC_API int scalc_bind(scalc_context *context, const char *name, double *value);
+
+// Limits scalc_eval_batch to the given number of threads; 0, the default, means one
+// per hardware thread. Loops inside the expression split up on their own.
+SCALC_API void scalc_threads(scalc_context *context, unsigned threads);
+
+// Returns the value of the expression, or nan with scalc_error set.
+SCALC_API double scalc_eval(scalc_context *context);
+
+// Evaluates the expression n times, the kth time with every bound pointer p read as
+// p[k], and stores the kth value in results[k]. Returns 0, or -1 with scalc_error set.
+SCALC_API int scalc_eval_batch(scalc_context *context, size_t n, double *results);
+
+// The message of the last failed evaluation, or NULL after a successful one.
+SCALC_API const char *scalc_error(const scalc_context *context);
+
+#ifdef __cplusplus
+}
+
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace scalc {
+
+// The C API with owning handles, raising std::runtime_error where it reports errors.
+class Expression {
+	scalc_expr *expr;
+public:
+	explicit Expression(const std::string &source) {
+		char error[256];
+		expr = scalc_compile(source.c_str(), error, sizeof error);
+		if(not expr) throw std::runtime_error(error);
+	}
+	Expression(const Expression &) = delete;
+	Expression &operator=(const Expression &) = delete;
+	~Expression() { scalc_free(expr); }
+	const scalc_expr *get() const { return expr; }
+};
+
+class Context {
+	scalc_context *context;
+	void check() const {
+		if(const char *message = scalc_error(context)) throw std::runtime_error(message);
+	}
+public:
+	explicit Context(const Expression &expr) : context(scalc_context_new(expr.get())) {
+		if(not context) throw std::bad_alloc();
+	}
+	Context(const Context &) = delete;
+	Context &operator=(const Context &) = delete;
+	~Context() { scalc_context_free(context); }
+	bool bind(const std::string &name, double *value) {
+		return scalc_bind(context, name.c_str(), value) != 0;
+	}
+	void threads(unsigned n) {
+		scalc_threads(context, n);
+	}
+	double eval() {
+		double value = scalc_eval(context);
+		check();
+		return value;
+	}
+	void eval(size_t n, double *results) {
+		scalc_eval_batch(context, n, results);
+		check();
+	}
+};
+
+}
+#endif
+
+#endif
@@ -1,304 +1,199 @@
-#include <iostream>
 #include <fstream>
-#include <vector>
-#include <cctype>
-#include <string>
-#include <unordered_map>
-#include <cmath>
-#include <cstdlib>
-#include <stdexcept>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include "scalc.hpp"
+#if defined(__has_include)
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAS_MMAP
+#endif
+#endif
 
 #define APP_VERSION "0.1.1"
-#define MAX_DEPTH 128
-
-enum class TokenType {
-	NUMBER,
-	IDENTIFIER,
-	PLUS,
-	MINUS,
-	MULTIPLY,
-	DIVIDE,
-	POW,
-	LPAREN,
-	RPAREN,
-	EQUAL,
-	COMMA,
-	END
-};
-
-struct Token {
-	TokenType type;
-	std::string value;
-	Token(TokenType t, std::string v = "") : type(t), value(v) {}
-};
+#define JSONL_QUEUE 1024
+#define BATCH_ROWS 1048576
+#define CSV_BUFFER 4194304
+#define NPY_HEADER 128
+#define COMMAND_BITS 5
 
-class Lexer {
-	std::string input;
-	size_t pos = 0;
-public:
-	Lexer(const std::string &expr) : input(expr) {}
-	Token getNextToken() {
-		while(pos < input.size() && isspace(input[pos])){ pos++; }
-		if(pos >= input.size()) return Token(TokenType::END);
-		char ch = input[pos];
-		if(isdigit(ch) || ch == '.') {
-			std::string num;
-			while(pos < input.size() && (isdigit(input[pos]) || input[pos] == '.')) {
-				num += input[pos++];
-			}
-			return Token(TokenType::NUMBER, num);
-		}
-		if(isalpha(ch)) {
-			std::string ident;
-			while(pos < input.size() && (isalnum(input[pos]) || input[pos] == '_')) {
-				ident += input[pos++];
-			}
-			return Token(TokenType::IDENTIFIER, ident);
+template<class T>
+class Reactive {
+	struct Formula {
+		Program program;
+		std::vector<Symbol> inputs;
+	};
+	std::unordered_map<Symbol, Formula> formulas;
+	std::unordered_map<Symbol, std::vector<Symbol>> dependents;
+	void visit(Symbol name, std::unordered_map<Symbol, bool> &seen, std::vector<Symbol> &order) {
+		if(seen[name]) return;
+		seen[name] = true;
+		auto it = dependents.find(name);
+		if(it != dependents.end()) {
+			for(auto &user : it->second) visit(user, seen, order);
 		}
-		pos++;
-		switch(ch) {
-			case '+': 
-				return Token(TokenType::PLUS);
-			case '-': 
-				return Token(TokenType::MINUS);
-			case '*': 
-				return Token(TokenType::MULTIPLY);
-			case '/':
-				return Token(TokenType::DIVIDE);
-			case '(':
-				return Token(TokenType::LPAREN);
-			case ')':
-				return Token(TokenType::RPAREN);
-			case '=':
-				return Token(TokenType::EQUAL);
-			case ',':
-				return Token(TokenType::COMMA);
-		}
-		throw std::runtime_error("Unexpected character: " + std::string(1, ch));
+		order.push_back(name);
 	}
-};
-
-using umapsd = std::unordered_map<std::string, double>;
-
-struct ASTNode {
-	virtual ~ASTNode() = default;
-	virtual double evaluate(umapsd &variables) = 0;
-};
-
-struct NumberNode : public ASTNode {
-	double value;
-	NumberNode(double v) : value(v) {};
-	double evaluate(umapsd &variables) override {
-		return value;
-	} 
-};
-
-struct VariableNode : public ASTNode {
-	std::string name;
-	VariableNode(const std::string &n) : name(n) {}
-	double evaluate(umapsd &variables) override {
-		if(variables.find(name) == variables.end()) throw std::runtime_error("Undefined variable: " + name);
-		return variables[name];
+	// The names and every variable that depends on them, in topological order.
+	std::vector<Symbol> downstream(const std::vector<Symbol> &names) {
+		std::unordered_map<Symbol, bool> seen;
+		std::vector<Symbol> order;
+		for(auto &name : names) visit(name, seen, order);
+		std::reverse(order.begin(), order.end());
+		return order;
 	}
-};
-
-struct AssignmentNode : public ASTNode {
-	std::string name;
-	ASTNode *value;
-	AssignmentNode(const std::string &n, ASTNode *v) : name(n), value(v) {}
-	double evaluate(umapsd &variables) override {
-		double val = value->evaluate(variables);
-		variables[name] = val;
-		return val;
-	}
-};
-
-struct FunctionCallNode : public ASTNode {
-	std::string functionName;
-	std::vector<ASTNode *> arguments;
-	FunctionCallNode(const std::string &name, std::vector<ASTNode *> args)
-		: functionName(name), arguments(std::move(args)) {}
-	double evaluate(umapsd &variables) override {
-		if(arguments.size() == 1){
-			if(functionName == "sin") return std::sin(arguments[0]->evaluate(variables));
-			if(functionName == "cos") return std::cos(arguments[0]->evaluate(variables));
-			if(functionName == "tan") return std::tan(arguments[0]->evaluate(variables));
-			if(functionName == "asin") return std::asin(arguments[0]->evaluate(variables));
-			if(functionName == "acos") return std::acos(arguments[0]->evaluate(variables));
-			if(functionName == "atan") return std::atan(arguments[0]->evaluate(variables));
-
-			if(functionName == "sinh") return std::sinh(arguments[0]->evaluate(variables));
-			if(functionName == "cosh") return std::cosh(arguments[0]->evaluate(variables));
-			if(functionName == "tanh") return std::tanh(arguments[0]->evaluate(variables));
-			if(functionName == "asinh") return std::asinh(arguments[0]->evaluate(variables));
-			if(functionName == "acosh") return std::acosh(arguments[0]->evaluate(variables));
-			if(functionName == "atanh") return std::atanh(arguments[0]->evaluate(variables));
-
-			if(functionName == "sqrt") return std::sqrt(arguments[0]->evaluate(variables));
-			if(functionName == "cbrt") return std::cbrt(arguments[0]->evaluate(variables));
-			if(functionName == "exp") return std::exp(arguments[0]->evaluate(variables));
-			if(functionName == "ln") return std::log(arguments[0]->evaluate(variables));
-			if(functionName == "log10") return std::log10(arguments[0]->evaluate(variables));
-			if(functionName == "log2") return std::log2(arguments[0]->evaluate(variables));
-
-			if(functionName == "abs") return std::abs(arguments[0]->evaluate(variables));
-		}
-		else if(arguments.size() == 2) {
-			if(functionName == "log") return std::log(arguments[1]->evaluate(variables)) / std::log(arguments[0]->evaluate(variables));
-			if(functionName == "pow") return std::pow(arguments[0]->evaluate(variables), arguments[1]->evaluate(variables));
-			if(functionName == "mod") return std::fmod(arguments[0]->evaluate(variables), arguments[1]->evaluate(variables));
-		}
-		throw std::runtime_error("Unknown function: " + functionName);
-	}
-};
-
-struct UnaryOpNode : public ASTNode {
-	TokenType op;
-	ASTNode *operand;
-	UnaryOpNode(TokenType o, ASTNode *expr) : op(o), operand(expr) {}
-	double evaluate(umapsd &variables) override {
-		double val = operand->evaluate(variables);
-		switch(op) {
-			case TokenType::MINUS:
-				return -val;
-			default :
-				throw std::runtime_error("Invalid unary operator");
-		}
-	}
-};
-
-struct BinaryOpNode : public ASTNode {
-	TokenType op;
-	ASTNode *left, *right;
-	BinaryOpNode(TokenType o, ASTNode *l, ASTNode *r) : op(o), left(l), right(r) {}
 public:
-	double evaluate(umapsd &variables) override {
-		double lval = left->evaluate(variables);
-		double rval = right->evaluate(variables);
-		switch(op) {
-			case TokenType::PLUS:
-				return lval + rval;
-			case TokenType::MINUS:
-				return lval - rval;
-			case TokenType::MULTIPLY:
-				return lval * rval;
-			case TokenType::DIVIDE:
-				return lval / rval;
-			default:
-				throw std::runtime_error("Invalid operator");
+	bool enabled = false;
+	// Turns name back into a plain value. Every assignment does this, on or off, so a
+	// formula never outlives a value written while the mode was off.
+	void forget(Symbol name) {
+		auto it = formulas.find(name);
+		if(it == formulas.end()) return;
+		for(auto &input : it->second.inputs) {
+			auto &users = dependents[input];
+			users.erase(std::remove(users.begin(), users.end(), name), users.end());
 		}
+		formulas.erase(it);
 	}
-};
-
-class Parser {
-	Lexer lexer;
-	Token curtToken;
-	void consume(TokenType type) {
-		if(curtToken.type == type)curtToken = lexer.getNextToken();
-		else throw std::runtime_error("Unexpected token: " + curtToken.value);
+	// Inputs and self-referencing formulas are kept as plain values.
+	void define(Symbol name, Program program) {
+		forget(name);
+		std::vector<Symbol> inputs = references(program);
+		inputs.erase(std::remove(inputs.begin(), inputs.end(), Symbol("Ans")), inputs.end());
+		auto affected = downstream({ name });
+		bool cyclic = std::any_of(inputs.begin(), inputs.end(), [&](Symbol input) {
+			return std::find(affected.begin(), affected.end(), input) != affected.end();
+		});
+		if(inputs.empty() || cyclic) return;
+		for(auto &input : inputs) dependents[input].push_back(name);
+		formulas[name] = Formula{ std::move(program), std::move(inputs) };
 	}
-public:
-	Parser(const std::string &expr) : lexer(expr), curtToken(lexer.getNextToken()) {}
-	ASTNode *parseExpression() {
-		ASTNode *node = parseTerm();
-		while(curtToken.type ==  TokenType::PLUS || curtToken.type == TokenType::MINUS) {
-			TokenType op = curtToken.type;
-			consume(op);
-			node = new BinaryOpNode(op, node, parseTerm());
-		}
-		return node;
-	}
-	ASTNode *parseTerm() {
-		ASTNode *node = parseFactor();
-		while(curtToken.type == TokenType::MULTIPLY || curtToken.type == TokenType::DIVIDE) {
-			TokenType op = curtToken.type;
-			consume(op);
-			node = new BinaryOpNode(op, node, parseFactor());
-		}
-		return node;
-	}
-	ASTNode *parseFactor() {
-		if(curtToken.type == TokenType::MINUS) {
-			consume(TokenType::MINUS);
-			return new UnaryOpNode(TokenType::MINUS, parseFactor());
-		}
-		if(curtToken.type == TokenType::NUMBER) {
-			double value = std::stod(curtToken.value);
-			consume(TokenType::NUMBER);
-			return new NumberNode(value);
-		}
-		else if(curtToken.type == TokenType::IDENTIFIER) {
-			std::string name = curtToken.value;
-			consume(TokenType::IDENTIFIER);
-			if(curtToken.type == TokenType::LPAREN) {
-				return parseFunctionCall(name);
-			}
-			else if(curtToken.type == TokenType::EQUAL) {
-				consume(TokenType::EQUAL);
-				return new AssignmentNode(name, parseExpression());
-			}
-			return new VariableNode(name);
-		}
-		else if(curtToken.type == TokenType::LPAREN) {
-			consume(TokenType::LPAREN);
-			ASTNode *node = parseExpression();
-			consume(TokenType::RPAREN);
-			return node;
-		}
-		throw std::runtime_error("Unexpected token: " + curtToken.value);
-	}
-	ASTNode *parseFunctionCall(const std::string &funcName) {
-		consume(TokenType::LPAREN);
-		std::vector<ASTNode *> args;
-		if(curtToken.type != TokenType::RPAREN) {
-			do {
-				args.push_back(parseExpression());
-				if(curtToken.type == TokenType::COMMA) { consume(TokenType::COMMA); }
-				else { break; }
-			} while(true);
+	// Turns every variable computed from name into a plain value, e.g. when name goes away.
+	void drop(Symbol name) {
+		auto it = dependents.find(name);
+		if(it == dependents.end()) return;
+		auto users = it->second;
+		for(auto &user : users) forget(user);
+		dependents.erase(name);
+	}
+	// Recomputes every variable downstream of the names, which a line has just
+	// assigned, in topological order.
+	void update(const std::vector<Symbol> &names, Variables<T> &variables) {
+		for(auto &target : downstream(names)) {
+			if(std::find(names.begin(), names.end(), target) != names.end()) continue;
+			store(variables, target, evaluate(formulas[target].program, variables));
 		}
-		consume(TokenType::RPAREN);
-		return new FunctionCallNode(funcName, args);
 	}
 };
 
 struct Options {
 	std::vector<std::string> args;
-	bool help = false, version = false, once = false, file = false;
+	bool help = false, version = false, once = false, file = false, reactive = false, memo = false, jsonl = false;
 	bool exit = false;
+	std::string precision = "double";
+	std::string batch, output;
+	std::vector<std::string> inputs;
+	int digits = 6;
 	std::vector<std::string> files = { "init.scalc" };
 	Options(int argc, char **argv) {
 		for(int i = 1; i < argc; i++) {
 			args.push_back(argv[i]);
 			if(args.back() == "-h" || args.back() == "--help") {
 				exit = help = true;
-				output::help();
+				output::help(std::cout);
 				break;
 			}
 			if(args.back() == "-v" || args.back() == "--version") {
 				exit = version = true;
-				output::version();
+				output::version(std::cout);
 				break;
 			}
 			if(args.back() == "-o" || args.back() == "--once") {
 				once = true;
 			}
+			if(args.back() == "-r" || args.back() == "--reactive") {
+				reactive = true;
+			}
+			if(args.back() == "-m" || args.back() == "--memo") {
+				memo = true;
+			}
+			if(args.back() == "--jsonl") {
+				jsonl = true;
+			}
+			if(args.back() == "-i" || args.back() == "--interval") {
+				precision = "interval";
+			}
+			if(args.back() == "-c" || args.back() == "--complex") {
+				precision = "complex";
+			}
 			if(args.back() == "-f" || args.back() == "--file") {
 				if(++i < argc){
 					args.push_back(argv[i]);
 					files.push_back(args.back());
 				}
 			}
+			if(args.back() == "-p" || args.back() == "--precision") {
+				if(++i < argc){
+					args.push_back(argv[i]);
+					precision = args.back();
+				}
+			}
+			if(args.back() == "-b" || args.back() == "--batch") {
+				if(++i < argc){
+					args.push_back(argv[i]);
+					batch = args.back();
+				}
+			}
+			if(args.back() == "--in") {
+				if(++i < argc){
+					args.push_back(argv[i]);
+					inputs.push_back(args.back());
+				}
+			}
+			if(args.back() == "--out") {
+				if(++i < argc){
+					args.push_back(argv[i]);
+					output = args.back();
+				}
+			}
+			if(args.back() == "-d" || args.back() == "--digits") {
+				if(++i < argc){
+					args.push_back(argv[i]);
+					digits = std::atoi(argv[i]);
+				}
+			}
 		}
 	}
 	struct output {
-		static void help() {
+		static void help(std::ostream &out) {
 			std::string usage;
 			usage  = "Usage: scalc [options]\n";
 			usage += "Options:\n";
 			usage += "  -h --help         Display this information.\n";
 			usage += "  -v --version      Display calculator version information.\n";
 			usage += "  -o --once         Run the calculation only once and then exit.\n";
+			usage += "  -r --reactive     Recompute dependent variables when their inputs change.\n";
+			usage += "  -m --memo         Memoize calls to pure user-defined functions.\n";
+			usage += "     --jsonl        Answer JSON requests, one per line, on standard output.\n";
+			usage += "  -i --interval     Evaluate with rigorous intervals [lo, hi].\n";
+			usage += "  -c --complex      Evaluate with complex numbers; i is the imaginary unit.\n";
+			usage += "  -p <type>\n";
+			usage += "    --precision <type>\n";
+			usage += "                    Evaluate with float, double (default), long, quad, big,\n";
+			usage += "                    interval or complex.\n";
+			usage += "  -d <n>\n";
+			usage += "    --digits <n>    Print results with n significant digits (default 6).\n";
+			usage += "  -b <expression>\n";
+			usage += "    --batch <expression>\n";
+			usage += "                    Evaluate expression for each element of the --in columns.\n";
+			usage += "     --in <name>=<path>\n";
+			usage += "                    Read variable name from raw doubles or a .npy file.\n";
+			usage += "     --in <path>    Read the columns of a CSV file, named by its header row.\n";
+			usage += "     --out <path>   Write the batch results as raw doubles or, for a path\n";
+			usage += "                    ending in .npy, as a .npy file (default: raw to stdout).\n";
 			usage += "  -f <path>\n";
 			usage += "    --file <path>   Execute commands from specified file.\n";
 			usage += "Interactive commands:\n";
@@ -306,26 +201,167 @@ struct Options {
 			usage += "  :h :help          Display this information.\n";
 			usage += "  :f <paths>\n";
 			usage += "    :file <paths>   Execute commands from specified files.\n";
+			usage += "  :r [on|off]\n";
+			usage += "    :reactive [on|off]\n";
+			usage += "                    Toggle reactive recomputation of dependent variables.\n";
+			usage += "  :memo [name] [on|off]\n";
+			usage += "                    Toggle memoization of all or the named pure function.\n";
+			usage += "  :seed <n>         Restart rand and randn from seed n.\n";
 			usage += "  <expression>      Calculate expression. The result is stored variable 'Ans'.\n";
-			std::cout << usage << std::flush;
+			usage += "  <name>(<params>) = <expression>\n";
+			usage += "                    Define a function.\n";
+			out << usage << std::flush;
 		}
-		static void version() {
+		static void version(std::ostream &out) {
 			std::string ver;
 			ver  = "scalc " APP_VERSION "\n";
 			ver += "Copyright (C) 2025 Qvito\n";
-			std::cout << ver << std::flush;
+			out << ver << std::flush;
 		}
 	};
 };
 
-double calculate(std::string line, umapsd& variables){
+// Variables every session starts with besides Ans.
+template<class T>
+void predefine(Variables<T> &) {}
+void predefine(Variables<Complex> &variables) {
+	variables[Symbol("i")] = Complex(0.0, 1.0);
+}
+
+// Everything a calculator session reads and changes. Sessions share no mutable
+// state, so threads can run one each; results and errors go to the session's streams.
+template<class T>
+struct Session {
+	Variables<T> variables;
+	Functions functions;
+	Reactive<T> reactive;
+	bool memo, once;
+	bool failed = false; // whether the last line failed
+	std::ostream &out, &err;
+	Session(const Options &opts, std::ostream &o, std::ostream &e) : memo(opts.memo), once(opts.once), out(o), err(e) {
+		variables[Symbol("Ans")] = T(0);
+		predefine(variables);
+		reactive.enabled = opts.reactive;
+		out.precision(opts.digits);
+	}
+	void report(const std::string &message) {
+		err << "\033[31mError: " << message << "\033[0m" << std::endl;
+		failed = true;
+	}
+};
+
+// Where name first appears as a variable in the line.
+size_t locate(const std::string &line, const std::string &name) {
+	Lexer lexer(line);
+	for(Token token = lexer.getNextToken(); token.type != TokenType::END; token = lexer.getNextToken()) {
+		if(token.type == TokenType::IDENTIFIER && token.value == name) return token.position;
+	}
+	return std::string::npos;
+}
+
+// Returns false when the line produced no value: a function definition, or a line
+// that failed to parse or compile or uses an undefined variable. Those failures come
+// back in failure rather than as exceptions, so a script full of them stays cheap.
+template<class T>
+bool calculate(const std::string &line, Session<T>& session, Failure &failure){
+	auto &variables = session.variables;
+	auto &functions = session.functions;
+	auto &reactive = session.reactive;
 	Parser parser(line);
-	ASTNode *expr = parser.parseExpression();
-	double value = expr->evaluate(variables);
-	delete expr;
-	return value;
+	ASTNode *expr = parser.parse();
+	if(parser.failure) {
+		failure = parser.failure;
+		return false;
+	}
+	if(auto definition = dynamic_cast<FunctionDefinitionNode *>(expr)) {
+		if(auto function = definition->define(functions, session.memo, failure)) functions[definition->name] = function;
+		return false;
+	}
+	Program program;
+	Compiler compiler(program, functions);
+	expr->compile(compiler);
+	compiler.store(Symbol("Ans"));
+	failure = compiler.failure;
+	std::string name = failure ? "" : undefined(program, variables);
+	if(not name.empty()) failure = Failure{ "Undefined variable: " + name, locate(line, name) };
+	if(failure) return false;
+	evaluate(program, variables);
+	// Every variable the line assigns, however deeply, now holds a plain value. Only
+	// the chain a = b = expr gets the formula expr back, and only if expr assigns
+	// nothing itself, since updating it would run those assignments again.
+	std::vector<Symbol> assigned;
+	assignments(program, assigned);
+	for(auto &name : assigned) reactive.forget(name);
+	if(not reactive.enabled) return true;
+	std::vector<Symbol> chain;
+	ASTNode *value = expr;
+	while(auto node = dynamic_cast<AssignmentNode *>(value)) {
+		if(node->name != Symbol("Ans")) chain.push_back(node->name);
+		value = node->value;
+	}
+	Program formula;
+	Compiler formulaCompiler(formula, functions);
+	value->compile(formulaCompiler);
+	std::vector<Symbol> effects;
+	assignments(formula, effects);
+	if(effects.empty()) {
+		for(auto it = chain.rbegin(); it != chain.rend(); ++it) reactive.define(*it, formula);
+	}
+	reactive.update(assigned, variables);
+	return true;
 }
 
+// :memo [name] [on|off]. Without a name, switches every pure function and the default for new definitions.
+void memoize(const std::vector<std::string>& terms, Functions& functions, bool& all) {
+	size_t at = 1;
+	Memo *memo = nullptr;
+	if(at < terms.size() && terms[at] != "on" && terms[at] != "off") {
+		auto it = functions.find(Symbol(terms[at]));
+		if(it == functions.end()) throw std::runtime_error("Unknown function: " + terms[at]);
+		memo = it->second->body.memo.get();
+		if(not memo) throw std::runtime_error("Cannot memoize impure function: " + terms[at]);
+		at++;
+	}
+	bool enabled = memo ? not memo->enabled : not all;
+	if(at < terms.size()) {
+		if(terms[at] != "on" && terms[at] != "off") throw std::runtime_error("Unknown memo mode: " + terms[at]);
+		enabled = terms[at] == "on";
+	}
+	if(memo) {
+		memo->enabled = enabled;
+		return;
+	}
+	all = enabled;
+	for(auto &function : functions) {
+		if(function.second->body.memo) function.second->body.memo->enabled = enabled;
+	}
+}
+
+enum class Command { EXIT, HELP, FILE, REACTIVE, SEED, MEMO };
+
+struct CommandName {
+	const char *name;
+	Command command;
+};
+
+constexpr CommandName commandNames[] = {
+	{ "e", Command::EXIT },
+	{ "exit", Command::EXIT },
+	{ "h", Command::HELP },
+	{ "help", Command::HELP },
+	{ "f", Command::FILE },
+	{ "file", Command::FILE },
+	{ "r", Command::REACTIVE },
+	{ "reactive", Command::REACTIVE },
+	{ "seed", Command::SEED },
+	{ "memo", Command::MEMO }
+};
+
+struct Commands {
+	static constexpr size_t count = sizeof commandNames / sizeof *commandNames;
+	static constexpr const char *name(size_t k) { return commandNames[k].name; }
+};
+
 std::vector<std::string> commandsDivide(const std::string& input) {
 	std::vector<std::string> terms;
 	if (input.empty() || input[0] != ':') return terms;
@@ -381,54 +417,1089 @@ std::vector<std::string> commandsDivide(const std::string& input) {
 	return terms;
 }
 
-void process(std::istream& stream, bool write, umapsd& variables, Options& opts, int depth) {
+template<class T>
+void process(std::istream& stream, bool write, Session<T>& session, int depth) {
 	if(MAX_DEPTH < depth)return;
 	std::string line;
 	do {
-		if(write)std::cout << "> ";
+		if(write)session.out << "> ";
 		if(not std::getline(stream, line))break;
 		if(line.empty())continue;
+		session.failed = false;
 		if(line[0] == ':'){
-			auto terms = commandsDivide(line);
-			if(terms.empty())continue;
-			if(terms[0] == "e" || terms[0] == "exit") {
-				break;
-			}
-			if(terms[0] == "h" || terms[0] == "help") {
-				if(write)Options::output::help();
-			}
-			if(terms[0] == "f" || terms[0] == "file") {
-				for(int i = 1; i < int(terms.size()); i++) {
-					std::ifstream file(terms[i]);
-					if (file.is_open()) {
-						process(file, false, variables, opts, depth + 1);
+			try {
+				auto terms = commandsDivide(line);
+				if(terms.empty())continue;
+				int k = PerfectHash<Commands, COMMAND_BITS>::find(terms[0].data(), terms[0].size());
+				if(k < 0)continue;
+				Command command = commandNames[k].command;
+				if(command == Command::EXIT) {
+					break;
+				}
+				if(command == Command::HELP) {
+					if(write)Options::output::help(session.out);
+				}
+				if(command == Command::FILE) {
+					for(int i = 1; i < int(terms.size()); i++) {
+						std::ifstream file(terms[i]);
+						if (file.is_open()) {
+							process(file, false, session, depth + 1);
+						}
+						else session.report("Cannot open file " + terms[i]);
 					}
-					else std::cerr << "\033[31mError: Cannot open file " << terms[i] << "\033[0m" << std::endl;
 				}
+				if(command == Command::REACTIVE) {
+					auto &reactive = session.reactive;
+					if(terms.size() < 2) reactive.enabled = not reactive.enabled;
+					else if(terms[1] == "on") reactive.enabled = true;
+					else if(terms[1] == "off") reactive.enabled = false;
+					else session.report("Unknown reactive mode " + terms[1]);
+				}
+				if(command == Command::SEED) {
+					if(terms.size() < 2) throw std::runtime_error("Missing seed");
+					try {
+						reseed(std::stoull(terms[1]));
+					}
+					catch(const std::logic_error &) {
+						throw std::runtime_error("Invalid seed " + terms[1]);
+					}
+				}
+				if(command == Command::MEMO) {
+					memoize(terms, session.functions, session.memo);
+				}
+			}
+			catch(const std::exception &e) {
+				session.report(e.what());
 			}
 			continue;
 		}
 		try {
-			double result = calculate("Ans = " + line, variables);
-			if(write)std::cout << "Ans: " << result << std::endl;
+			Failure failure;
+			bool value = calculate(line, session, failure);
+			if(failure) session.report(failure.describe());
+			else if(value && write) {
+				session.out << "Ans: ";
+				auto array = session.variables.arrays.find(Symbol("Ans"));
+				if(array != session.variables.arrays.end()) print(session.out, *array->second);
+				else print(session.out, session.variables[Symbol("Ans")]);
+				session.out << std::endl;
+			}
 		}
 		catch(const std::exception &e) {
-			std::cerr << "\033[31m" << "Error: " << e.what() << "\033[0m" << std::endl;
+			session.report(e.what());
 		}
-	} while(not opts.once || not write);
+	} while(not session.once || not write);
 }
 
-int main(int argc, char **argv){
-	Options opts(argc, argv);
-	if(opts.exit) { return 0; }
-	umapsd variables;
-	variables["Ans"] = 0.0;
+// A variable given with a --jsonl request: a number, an array, or a matrix as an array of rows.
+struct Binding {
+	std::string name;
+	std::vector<double> elements;
+	uint64_t width = 0;
+	bool array = false;
+};
+
+// One line of --jsonl input. Slots are reused from line to line, so their buffers
+// keep their capacity; only the first `count` bindings belong to the current line.
+struct Request {
+	std::string line, key, id, expr;
+	std::vector<Binding> vars;
+	size_t count = 0;
+	Failure failure;
+};
+
+// Reads a request object in place. Members other than id, expr and vars are skipped,
+// and id is kept as its JSON text to be echoed back.
+class JsonReader {
+	const std::string &text;
+	size_t pos = 0;
+	bool fail(const std::string &message) {
+		if(not failure) failure = Failure{ pos < text.size() ? message : "Unexpected end of input", pos };
+		return false;
+	}
+	void space() {
+		while(pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n')) pos++;
+	}
+	bool next(char ch) {
+		space();
+		if(pos >= text.size() || text[pos] != ch) return false;
+		pos++;
+		return true;
+	}
+	bool expect(char ch) {
+		return next(ch) || fail(std::string("Expected ") + ch);
+	}
+	bool hex(uint32_t &code) {
+		code = 0;
+		for(int k = 0; k < 4; k++, pos++) {
+			if(pos >= text.size() || not isxdigit(text[pos])) return fail("Invalid escape");
+			char ch = char(tolower(text[pos]));
+			code = code * 16 + uint32_t(isdigit(ch) ? ch - '0' : ch - 'a' + 10);
+		}
+		return true;
+	}
+	static void utf8(std::string &out, uint32_t code) {
+		if(code < 0x80) out += char(code);
+		else if(code < 0x800) {
+			out += char(0xc0 | code >> 6);
+			out += char(0x80 | (code & 0x3f));
+		}
+		else if(code < 0x10000) {
+			out += char(0xe0 | code >> 12);
+			out += char(0x80 | (code >> 6 & 0x3f));
+			out += char(0x80 | (code & 0x3f));
+		}
+		else {
+			out += char(0xf0 | code >> 18);
+			out += char(0x80 | (code >> 12 & 0x3f));
+			out += char(0x80 | (code >> 6 & 0x3f));
+			out += char(0x80 | (code & 0x3f));
+		}
+	}
+	// Without out, only checks the string.
+	bool string(std::string *out) {
+		if(not expect('"')) return false;
+		if(out) out->clear();
+		while(pos < text.size()) {
+			char ch = text[pos++];
+			if(ch == '"') return true;
+			if(static_cast<unsigned char>(ch) < 0x20) {
+				pos--;
+				return fail("Control character in string");
+			}
+			if(ch != '\\') {
+				if(out) *out += ch;
+				continue;
+			}
+			if(pos >= text.size()) break;
+			switch(ch = text[pos++]) {
+				case '"': case '\\': case '/': break;
+				case 'b': ch = '\b'; break;
+				case 'f': ch = '\f'; break;
+				case 'n': ch = '\n'; break;
+				case 'r': ch = '\r'; break;
+				case 't': ch = '\t'; break;
+				case 'u': {
+					uint32_t code, low;
+					if(not hex(code)) return false;
+					if(0xd800 <= code && code < 0xdc00) {
+						if(text.compare(pos, 2, "\\u") != 0) return fail("Invalid escape");
+						pos += 2;
+						if(not hex(low)) return false;
+						if(low < 0xdc00 || 0xe000 <= low) return fail("Invalid escape");
+						code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+					}
+					if(out) utf8(*out, code);
+					continue;
+				}
+				default:
+					pos--;
+					return fail("Invalid escape");
+			}
+			if(out) *out += ch;
+		}
+		return fail("Unterminated string");
+	}
+	bool digits() {
+		if(pos >= text.size() || not isdigit(text[pos])) return false;
+		while(pos < text.size() && isdigit(text[pos])) pos++;
+		return true;
+	}
+	// Checks the JSON grammar first, since strtod also takes hex, inf, nan, "1." and ".5".
+	bool number(double &value) {
+		space();
+		size_t start = pos;
+		if(pos < text.size() && text[pos] == '-') pos++;
+		if(pos >= text.size() || not isdigit(text[pos])) {
+			pos = start;
+			return fail("Expected a number");
+		}
+		if(text[pos] == '0') pos++;
+		else digits();
+		if(pos < text.size() && text[pos] == '.') {
+			pos++;
+			if(not digits()) return fail("Invalid number");
+		}
+		if(pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+			pos++;
+			if(pos < text.size() && (text[pos] == '+' || text[pos] == '-')) pos++;
+			if(not digits()) return fail("Invalid number");
+		}
+		if(pos < text.size() && (isalnum(text[pos]) || text[pos] == '.')) return fail("Invalid number");
+		char buffer[64];
+		size_t size = pos - start;
+		if(size < sizeof buffer) {
+			std::memcpy(buffer, text.data() + start, size);
+			buffer[size] = '\0';
+			value = std::strtod(buffer, nullptr);
+		}
+		else value = std::strtod(text.substr(start, size).c_str(), nullptr);
+		return true;
+	}
+	bool skip(int depth) {
+		space();
+		if(MAX_DEPTH < depth) return fail("Nested too deeply");
+		if(pos >= text.size()) return fail("");
+		char open = text[pos];
+		if(open == '"') return string(nullptr);
+		if(open == '{' || open == '[') {
+			char close = open == '{' ? '}' : ']';
+			pos++;
+			if(next(close)) return true;
+			do {
+				if(open == '{' && not (string(nullptr) && expect(':'))) return false;
+				if(not skip(depth + 1)) return false;
+			} while(next(','));
+			return expect(close);
+		}
+		for(const char *word : { "true", "false", "null" }) {
+			size_t size = std::strlen(word);
+			if(text.compare(pos, size, word) != 0) continue;
+			pos += size;
+			return true;
+		}
+		double value;
+		return number(value);
+	}
+	bool row(Binding &binding) {
+		if(not expect('[')) return false;
+		size_t start = binding.elements.size();
+		do {
+			double value;
+			if(not number(value)) return false;
+			binding.elements.push_back(value);
+		} while(next(','));
+		if(not expect(']')) return false;
+		uint64_t width = binding.elements.size() - start;
+		if(binding.width && width != binding.width) return fail("Rows differ in length");
+		binding.width = width;
+		return true;
+	}
+	// A number, an array of numbers, or an array of rows.
+	bool read(Binding &binding) {
+		binding.elements.clear();
+		binding.width = 0;
+		binding.array = next('[');
+		double value;
+		if(not binding.array) {
+			if(not number(value)) return false;
+			binding.elements.push_back(value);
+			return true;
+		}
+		if(next(']')) return true;
+		space();
+		bool rows = pos < text.size() && text[pos] == '[';
+		do {
+			if(rows) {
+				if(not row(binding)) return false;
+				continue;
+			}
+			if(not number(value)) return false;
+			binding.elements.push_back(value);
+		} while(next(','));
+		return expect(']');
+	}
+public:
+	Failure failure;
+	explicit JsonReader(const std::string &t) : text(t) {}
+	bool read(Request &request) {
+		request.id = "null";
+		request.expr.clear();
+		request.count = 0;
+		bool expr = false;
+		if(not expect('{')) return false;
+		if(not next('}')) {
+			do {
+				if(not (string(&request.key) && expect(':'))) return false;
+				if(request.key == "id") {
+					space();
+					size_t start = pos;
+					if(not skip(0)) return false;
+					request.id.assign(text, start, pos - start);
+				}
+				else if(request.key == "expr") {
+					if(not string(&request.expr)) return false;
+					expr = true;
+				}
+				else if(request.key == "vars") {
+					if(not expect('{')) return false;
+					if(next('}')) continue;
+					do {
+						if(request.count == request.vars.size()) request.vars.emplace_back();
+						Binding &binding = request.vars[request.count++];
+						space();
+						size_t at = pos;
+						if(not string(&binding.name)) return false;
+						if(not Lexer::identifier(binding.name) || binding.name == "Ans") {
+							pos = at;
+							return fail("Invalid variable name: " + binding.name);
+						}
+						if(not (expect(':') && read(binding))) return false;
+					} while(next(','));
+					if(not expect('}')) return false;
+				}
+				else if(not skip(0)) return false;
+			} while(next(','));
+			if(not expect('}')) return false;
+		}
+		space();
+		if(pos < text.size()) return fail("Unexpected text after the request");
+		if(not expr) failure = Failure{ "Missing expr" };
+		return expr;
+	}
+};
+
+// Requests pass from the reading thread to the evaluating one through a ring of
+// JSONL_QUEUE slots. Each thread works on its slots outside the lock.
+class Pipeline {
+	std::vector<Request> slots;
+	size_t head = 0, count = 0;
+	bool closed = false;
+	std::mutex mutex;
+	std::condition_variable changed;
+public:
+	Pipeline() : slots(JSONL_QUEUE) {}
+	// The slot to fill next, once one is free.
+	Request &back() {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&] { return count < slots.size(); });
+		return slots[(head + count) % slots.size()];
+	}
+	void push() {
+		std::lock_guard<std::mutex> lock(mutex);
+		count++;
+		changed.notify_one();
+	}
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		changed.notify_one();
+	}
+	// The oldest filled slot, or nullptr once the input is done.
+	Request *front() {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&] { return count || closed; });
+		return count ? &slots[head] : nullptr;
+	}
+	// Frees the front slot. Returns whether another request is waiting.
+	bool pop() {
+		std::lock_guard<std::mutex> lock(mutex);
+		head = (head + 1) % slots.size();
+		count--;
+		changed.notify_one();
+		return count != 0;
+	}
+};
+
+void quote(std::string &out, const std::string &text) {
+	out += '"';
+	for(char ch : text) {
+		if(ch == '"' || ch == '\\') {
+			out += '\\';
+			out += ch;
+		}
+		else if(ch == '\n') out += "\\n";
+		else if(ch == '\t') out += "\\t";
+		else if(static_cast<unsigned char>(ch) < 0x20) {
+			char escape[8];
+			std::snprintf(escape, sizeof escape, "\\u%04x", unsigned(ch));
+			out += escape;
+		}
+		else out += ch;
+	}
+	out += '"';
+}
+
+// Printed numbers are JSON numbers as they are; anything else, such as nan, an
+// interval or a complex number, goes out as a string.
+void number(std::string &out, const char *text) {
+	bool numeric = isdigit(text[0]) || (text[0] == '-' && isdigit(text[1]));
+	if(numeric && std::strspn(text, "0123456789+-.eE") == std::strlen(text)) out += text;
+	else quote(out, text);
+}
+
+template<class T>
+void json(std::string &out, const T &value, int digits) {
+	static thread_local std::ostringstream text;
+	text.str(std::string());
+	text.precision(digits);
+	print(text, value);
+	number(out, text.str().c_str());
+}
+
+void json(std::string &out, double value, int digits) {
+	char text[64];
+	std::snprintf(text, sizeof text, "%.*g", digits, value);
+	number(out, text);
+}
+
+void json(std::string &out, float value, int digits) {
+	json(out, double(value), digits);
+}
+
+// Every element, without the shortening the interactive output does. A matrix is an array of rows.
+template<class T>
+void json(std::string &out, const Array<T> &array, int digits) {
+	if(array.empty()) {
+		out += "[]";
+		return;
+	}
+	uint64_t width = array.width ? array.width : array.size();
+	out += array.width ? "[[" : "[";
+	for(uint64_t k = 0; k < array.size(); k++) {
+		if(k) out += k % width ? "," : "],[";
+		json(out, array[k], digits);
+	}
+	out += array.width ? "]]" : "]";
+}
+
+// Binds the request's variables and evaluates its expression in the session, then
+// appends the value member to the response. The bindings last for this request only:
+// afterwards, whether it succeeded or not, the names hold what they held before, and
+// names it introduced are gone again.
+template<class T>
+void answer(const Request &request, Session<T> &session, Failure &failure, std::string &response) {
+	auto &variables = session.variables;
+	auto &reactive = session.reactive;
+	Variables<T> saved;
+	std::vector<Symbol> bound;
+	for(size_t k = 0; k < request.count; k++) {
+		auto &binding = request.vars[k];
+		Symbol name(binding.name);
+		if(std::find(bound.begin(), bound.end(), name) == bound.end()) {
+			bound.push_back(name);
+			auto scalar = variables.find(name);
+			if(scalar != variables.end()) saved[name] = scalar->second;
+			auto array = variables.arrays.find(name);
+			if(array != variables.arrays.end()) saved.arrays[name] = array->second;
+		}
+		if(binding.array) {
+			auto elements = std::make_shared<Array<T>>(binding.elements.begin(), binding.elements.end());
+			elements->width = binding.width;
+			variables.erase(name);
+			variables.arrays[name] = elements;
+		}
+		else store(variables, name, T(binding.elements[0]));
+	}
+	auto restore = [&] {
+		std::vector<Symbol> restored;
+		for(auto &name : bound) {
+			variables.erase(name);
+			variables.arrays.erase(name);
+			auto scalar = saved.find(name);
+			auto array = saved.arrays.find(name);
+			if(scalar != saved.end()) variables[name] = scalar->second;
+			if(array != saved.arrays.end()) variables.arrays[name] = array->second;
+			if(scalar == saved.end() && array == saved.arrays.end()) reactive.drop(name);
+			else restored.push_back(name);
+		}
+		if(reactive.enabled && not restored.empty()) reactive.update(restored, variables);
+	};
+	try {
+		if(reactive.enabled && not bound.empty()) reactive.update(bound, variables);
+		bool value = calculate(request.expr, session, failure);
+		if(not failure) {
+			int digits = int(session.out.precision());
+			response += ",\"value\":";
+			auto array = variables.arrays.find(Symbol("Ans"));
+			if(not value) response += "null";
+			else if(array != variables.arrays.end()) json(response, *array->second, digits);
+			else json(response, variables[Symbol("Ans")], digits);
+		}
+	}
+	catch(...) {
+		restore();
+		throw;
+	}
+	restore();
+}
+
+// --jsonl: one request per input line, one response per output line in the same order.
+// A reading thread parses lines while this one evaluates, and output is flushed
+// whenever no request is waiting.
+template<class T>
+void serve(std::istream &input, Session<T> &session) {
+	Pipeline pipeline;
+	std::thread reader([&] {
+		for(;;) {
+			Request &request = pipeline.back();
+			if(not std::getline(input, request.line)) break;
+			if(request.line.find_first_not_of(" \t\r") == std::string::npos) continue;
+			JsonReader parser(request.line);
+			parser.read(request);
+			request.failure = parser.failure;
+			pipeline.push();
+		}
+		pipeline.close();
+	});
+	std::string response;
+	while(Request *request = pipeline.front()) {
+		response = "{\"id\":";
+		response += request->id;
+		Failure failure = request->failure;
+		if(not failure) {
+			try {
+				answer(*request, session, failure, response);
+			}
+			catch(const std::exception &e) {
+				failure = Failure{ e.what() };
+			}
+		}
+		if(failure) {
+			response += ",\"error\":";
+			quote(response, failure.message);
+			if(failure.position != std::string::npos) response += ",\"column\":" + std::to_string(failure.position + 1);
+		}
+		response += "}\n";
+		session.out.write(response.data(), response.size());
+		if(not pipeline.pop()) session.out.flush();
+	}
+	reader.join();
+	session.out.flush();
+}
+
+// A file mapped read-only into memory, or read into a buffer where it cannot be
+// mapped, such as a pipe.
+class Mapping {
+	void *base = nullptr;
+	std::vector<char> buffer;
+public:
+	const char *data = nullptr;
+	size_t size = 0;
+	explicit Mapping(const std::string &path) {
+#ifdef HAS_MMAP
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0) throw std::runtime_error("Cannot open file " + path);
+		struct stat info;
+		if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && 0 < info.st_size) {
+			void *mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if(mapped != MAP_FAILED) {
+				madvise(mapped, size_t(info.st_size), MADV_SEQUENTIAL);
+				base = mapped;
+				data = static_cast<const char *>(mapped);
+				size = size_t(info.st_size);
+			}
+		}
+		close(fd);
+		if(base) return;
+#endif
+		std::ifstream file(path, std::ios::binary);
+		if(not file) throw std::runtime_error("Cannot open file " + path);
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		data = buffer.data();
+		size = buffer.size();
+	}
+	Mapping(const Mapping &) = delete;
+	Mapping &operator=(const Mapping &) = delete;
+	~Mapping() {
+#ifdef HAS_MMAP
+		if(base) munmap(base, size);
+#endif
+	}
+};
+
+bool littleEndian() {
+	uint16_t one = 1;
+	unsigned char first;
+	std::memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+// A column of doubles read from a file: raw little-endian doubles, or a .npy array of
+// '<f8' whose second dimension, if any, makes it a matrix. The elements are read in
+// place unless the file leaves them misaligned.
+struct BinaryColumn {
+	std::unique_ptr<Mapping> file;
+	std::vector<double> copy;
+	const double *data = nullptr;
+	uint64_t size = 0, width = 0;
+};
+
+// The value of key in the header dictionary of a .npy file.
+std::string npyField(const std::string &header, const std::string &key) {
+	size_t at = header.find("'" + key + "'");
+	if(at == std::string::npos) return "";
+	at = header.find(':', at);
+	if(at == std::string::npos) return "";
+	at = header.find_first_not_of(' ', at + 1);
+	if(at == std::string::npos) return "";
+	size_t end = header[at] == '(' ? header.find(')', at) + 1 : header.find_first_of(",}", at);
+	return header.substr(at, end == std::string::npos ? std::string::npos : end - at);
+}
+
+BinaryColumn readColumn(const std::string &path) {
+	if(not littleEndian()) throw std::runtime_error("Binary columns need a little-endian machine");
+	BinaryColumn column;
+	column.file.reset(new Mapping(path));
+	const char *bytes = column.file->data;
+	size_t size = column.file->size, offset = 0;
+	if(6 <= size && std::memcmp(bytes, "\x93NUMPY", 6) == 0) {
+		if(size < 12) throw std::runtime_error("Truncated NPY file " + path);
+		uint32_t length = uint8_t(bytes[8]) | uint32_t(uint8_t(bytes[9])) << 8;
+		offset = 10;
+		if(bytes[6] != 1) {
+			length |= uint32_t(uint8_t(bytes[10])) << 16 | uint32_t(uint8_t(bytes[11])) << 24;
+			offset = 12;
+		}
+		if(size < offset + length) throw std::runtime_error("Truncated NPY file " + path);
+		std::string header(bytes + offset, length);
+		offset += length;
+		std::string type = npyField(header, "descr");
+		if(type != "'<f8'") throw std::runtime_error("Unsupported NPY type " + type + " in " + path + ", expected '<f8'");
+		std::string shape = npyField(header, "shape");
+		std::vector<uint64_t> dimensions;
+		for(size_t at = shape.find_first_of("0123456789"); at != std::string::npos; at = shape.find_first_of("0123456789", at)) {
+			char *end;
+			dimensions.push_back(std::strtoull(shape.c_str() + at, &end, 10));
+			at = size_t(end - shape.c_str());
+		}
+		if(shape.empty() || 2 < dimensions.size()) throw std::runtime_error("Unsupported NPY shape " + shape + " in " + path);
+		column.size = 1;
+		for(auto dimension : dimensions) column.size *= dimension;
+		if(dimensions.size() == 2) {
+			if(npyField(header, "fortran_order") == "True") throw std::runtime_error("Fortran-ordered NPY arrays are not supported: " + path);
+			column.width = dimensions[1];
+		}
+		if((size - offset) / sizeof(double) < column.size) throw std::runtime_error("Truncated NPY file " + path);
+	}
+	else {
+		if(size % sizeof(double)) throw std::runtime_error("Size of " + path + " is not a multiple of 8 bytes");
+		column.size = size / sizeof(double);
+	}
+	const char *start = bytes + offset;
+	if(reinterpret_cast<uintptr_t>(start) % alignof(double)) {
+		column.copy.resize(column.size);
+		std::memcpy(column.copy.data(), start, column.size * sizeof(double));
+		column.data = column.copy.data();
+	}
+	else column.data = reinterpret_cast<const double *>(start);
+	return column;
+}
+
+// Parses a decimal number. With at most 19 significant digits and a power of ten
+// up to 22 it is the correctly rounded product or quotient of two exact doubles;
+// anything else, such as nan or a long mantissa, goes through strtod. Empty is nan.
+bool parseNumber(const char *p, const char *end, double &value) {
+	while(p < end && (*p == ' ' || *p == '"')) p++;
+	while(p < end && (end[-1] == ' ' || end[-1] == '"')) end--;
+	if(p == end) {
+		value = NAN;
+		return true;
+	}
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char *start = p;
+	bool negative = *p == '-';
+	if(negative || *p == '+') p++;
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false, exact = true;
+	for(bool point = false; p < end; p++) {
+		if(*p == '.' && not point) {
+			point = true;
+			continue;
+		}
+		unsigned digit = unsigned(*p - '0');
+		if(9 < digit) break;
+		any = true;
+		if(digits < 19) {
+			mantissa = mantissa * 10 + digit;
+			if(mantissa) digits++;
+			if(point) exponent--;
+		}
+		else {
+			exact = exact && digit == 0;
+			if(not point) exponent++;
+		}
+	}
+	if(any && p < end && (*p == 'e' || *p == 'E')) {
+		const char *mark = p++;
+		bool minus = p < end && *p == '-';
+		if(p < end && (*p == '-' || *p == '+')) p++;
+		int power = 0;
+		bool some = false;
+		for(; p < end && unsigned(*p - '0') < 10; p++) {
+			power = std::min(power * 10 + (*p - '0'), 100000);
+			some = true;
+		}
+		if(not some) p = mark;
+		exponent += minus ? -power : power;
+	}
+	if(any && p == end && exact && mantissa <= (uint64_t(1) << 53) && -22 <= exponent && exponent <= 22) {
+		value = exponent < 0 ? double(mantissa) / powers[-exponent] : double(mantissa) * powers[exponent];
+		if(negative) value = -value;
+		return true;
+	}
+	std::string text(start, end);
+	char *stop;
+	value = std::strtod(text.c_str(), &stop);
+	return *stop == '\0' && stop != text.c_str();
+}
+
+// Reads the columns of a CSV file with a header row of names, up to BATCH_ROWS rows
+// at a time, so that memory stays bounded however long the file is. Lines are found
+// with memchr, which the C library vectorizes, and threads parse bands of them. Only
+// the columns in use are converted.
+class CsvReader {
+	std::ifstream file;
+	std::vector<char> buffer;
+	size_t begin = 0, end = 0; // the bytes not parsed yet
+	bool eof = false;
+	uint64_t rows = 0; // rows returned so far, for messages
+	std::vector<int> slots; // the column each field goes to, or -1
+	std::vector<std::pair<size_t, size_t>> lines; // first byte and newline of each row in the buffer
+	// Moves the unparsed bytes to the front and reads after them. Returns false at the end of the file.
+	bool fill() {
+		if(eof) return false;
+		std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+		end -= begin;
+		begin = 0;
+		if(end == buffer.size()) buffer.resize(buffer.size() * 2);
+		file.read(buffer.data() + end, std::streamsize(buffer.size() - end));
+		end += size_t(file.gcount());
+		if(file.bad()) throw std::runtime_error("Cannot read file " + path);
+		eof = file.eof();
+		return true;
+	}
+	// The end of the next complete line, reading more as needed; a last line without
+	// a newline gets one. nullptr at the end of the file.
+	const char *line() {
+		for(;;) {
+			auto newline = static_cast<const char *>(std::memchr(buffer.data() + begin, '\n', end - begin));
+			if(newline) return newline;
+			if(fill()) continue;
+			if(begin == end) return nullptr;
+			if(end == buffer.size()) buffer.push_back('\n');
+			else buffer[end] = '\n';
+			end++;
+		}
+	}
+	void parse(const char *p, const char *last, uint64_t row) {
+		if(p < last && last[-1] == '\r') last--;
+		// Fields missing at the end of a row are empty.
+		for(size_t f = 0; f < slots.size(); f++) {
+			auto stop = p <= last ? static_cast<const char *>(std::memchr(p, ',', size_t(last - p))) : nullptr;
+			if(not stop) stop = last;
+			if(0 <= slots[f] && not parseNumber(std::min(p, stop), stop, columns[size_t(slots[f])][row])) {
+				throw std::runtime_error("Invalid number '" + std::string(p, stop) + "' in " + path + ", row " + std::to_string(rows + row + 1));
+			}
+			p = stop + 1;
+		}
+	}
+public:
+	std::string path;
+	std::vector<std::string> names;
+	std::vector<std::vector<double>> columns;
+	explicit CsvReader(const std::string &p) : file(p, std::ios::binary), buffer(CSV_BUFFER), path(p) {
+		if(not file) throw std::runtime_error("Cannot open file " + path);
+		const char *newline = line();
+		if(not newline) throw std::runtime_error("Missing header in " + path);
+		const char *field = buffer.data() + begin, *last = newline;
+		if(field < last && last[-1] == '\r') last--;
+		for(bool more = true; more; ) {
+			auto stop = static_cast<const char *>(std::memchr(field, ',', size_t(last - field)));
+			more = stop != nullptr;
+			if(not more) stop = last;
+			const char *a = field, *b = stop;
+			while(a < b && (*a == ' ' || *a == '"')) a++;
+			while(a < b && (b[-1] == ' ' || b[-1] == '"')) b--;
+			names.emplace_back(a, b);
+			field = stop + 1;
+		}
+		begin = size_t(newline - buffer.data()) + 1;
+	}
+	// Where the named column will be read into, or -1 if the file has none.
+	int column(const std::string &name) {
+		size_t f = size_t(std::find(names.begin(), names.end(), name) - names.begin());
+		if(f == names.size()) return -1;
+		if(slots.size() <= f) slots.resize(f + 1, -1);
+		if(slots[f] < 0) {
+			slots[f] = int(columns.size());
+			columns.emplace_back();
+		}
+		return slots[f];
+	}
+	// Reads up to count rows, fewer only at the end of the file. Blank lines are skipped.
+	uint64_t read(uint64_t count) {
+		for(auto &column : columns) column.resize(count);
+		uint64_t done = 0;
+		while(done < count) {
+			if(not line()) break;
+			lines.clear();
+			const char *data = buffer.data();
+			size_t at = begin;
+			while(done + lines.size() < count) {
+				auto newline = static_cast<const char *>(std::memchr(data + at, '\n', end - at));
+				if(not newline) break;
+				size_t stop = size_t(newline - data);
+				if(stop - at > 1 || (stop - at == 1 && data[at] != '\r')) lines.emplace_back(at, stop);
+				at = stop + 1;
+			}
+			unsigned threads = concurrency(at - begin);
+			std::vector<std::exception_ptr> errors(threads);
+			parallel(lines.size(), threads, [&](unsigned t, uint64_t first, uint64_t last) {
+				try {
+					for(uint64_t l = first; l < last; l++) parse(data + lines[l].first, data + lines[l].second, done + l);
+				}
+				catch(...) {
+					errors[t] = std::current_exception();
+				}
+			});
+			for(auto &error : errors) {
+				if(error) std::rethrow_exception(error);
+			}
+			begin = at;
+			done += lines.size();
+		}
+		rows += done;
+		return done;
+	}
+};
+
+// Where batch results go: raw doubles, or a .npy file whose shape is filled in once
+// the number of results is known. Its header is NPY_HEADER bytes, enough for any shape.
+class ColumnWriter {
+	std::ofstream file;
+	std::ostream &out;
+	bool npy;
+	uint64_t width, count = 0;
+	std::vector<double> rounded;
+	void header() {
+		std::string shape = width ? "(" + std::to_string(count / width) + ", " + std::to_string(width) + ")" : "(" + std::to_string(count) + ",)";
+		std::string text = "{'descr': '<f8', 'fortran_order': False, 'shape': " + shape + ", }";
+		text.append(NPY_HEADER - 11 - text.size(), ' ');
+		text += '\n';
+		out.write("\x93NUMPY\x01\x00", 8);
+		out.put(char(text.size() & 0xff));
+		out.put(char(text.size() >> 8));
+		out << text;
+	}
+public:
+	std::string path;
+	ColumnWriter(const std::string &p, uint64_t w) : out(p.empty() ? std::cout : file), width(w), path(p.empty() ? "output" : p) {
+		if(not littleEndian()) throw std::runtime_error("Binary columns need a little-endian machine");
+		npy = 4 <= p.size() && p.compare(p.size() - 4, 4, ".npy") == 0;
+		if(p.empty()) return;
+		file.open(p, std::ios::binary);
+		if(not file) throw std::runtime_error("Cannot open file " + p);
+		if(npy) header();
+	}
+	void write(const double *values, uint64_t n) {
+		out.write(reinterpret_cast<const char *>(values), std::streamsize(n * sizeof(double)));
+		count += n;
+		if(not out) throw std::runtime_error("Cannot write " + path);
+	}
+	// Results of other types are rounded to double on the way out.
+	template<class T>
+	void write(const T *values, uint64_t n) {
+		rounded.resize(n);
+		for(uint64_t k = 0; k < n; k++) rounded[k] = double(values[k]);
+		write(rounded.data(), n);
+	}
+	void close() {
+		if(npy) {
+			out.seekp(0);
+			header();
+		}
+		out.flush();
+		if(not out) throw std::runtime_error("Cannot write " + path);
+	}
+};
+
+// Points a column at rows values read from source: in place when T is double and the
+// values are not written, otherwise converted or copied into buffer.
+template<class T>
+T *place(const double *source, uint64_t rows, bool, std::vector<T> &buffer) {
+	if(buffer.size() < rows) buffer.resize(BATCH_ROWS);
+	std::transform(source, source + rows, buffer.begin(), [](double x) { return T(x); });
+	return buffer.data();
+}
+
+double *place(const double *source, uint64_t rows, bool written, std::vector<double> &buffer) {
+	if(not written) return const_cast<double *>(source);
+	if(buffer.size() < rows) buffer.resize(BATCH_ROWS);
+	std::copy(source, source + rows, buffer.begin());
+	return buffer.data();
+}
+
+// --batch: evaluates the expression once per element of the --in columns and writes
+// its values to --out, BATCH_ROWS elements at a time. Inputs are doubles, converted
+// to the session's type a block at a time, and results are written as doubles. In
+// double precision, binary columns are read in place from the mapped files. Array
+// functions such as sum need whole columns, so with them the columns are loaded into
+// array variables instead.
+template<class T>
+int batch(Session<T> &session, const Options &opts) {
+	try {
+		std::vector<std::string> names;
+		std::vector<BinaryColumn> inputs;
+		std::vector<std::unique_ptr<CsvReader>> tables;
+		for(auto &input : opts.inputs) {
+			size_t at = input.find('=');
+			if(at == std::string::npos) {
+				tables.emplace_back(new CsvReader(input));
+				continue;
+			}
+			if(at == 0) throw std::runtime_error("Expected --in <name>=<path> or --in <path>.csv: " + input);
+			names.push_back(input.substr(0, at));
+			inputs.push_back(readColumn(input.substr(at + 1)));
+		}
+		if(inputs.empty() && tables.empty()) throw std::runtime_error("Batch mode needs an --in column");
+		uint64_t total = inputs.empty() ? 0 : inputs[0].size, width = 0;
+		for(auto &input : inputs) {
+			if(input.size != total) throw std::runtime_error("Array lengths differ: " + std::to_string(total) + " and " + std::to_string(input.size));
+			if(width && input.width && input.width != width) throw std::runtime_error("Matrix shapes differ");
+			if(input.width) width = input.width;
+		}
+		Parser parser(opts.batch);
+		ASTNode *node = parser.parse();
+		Failure failure = parser.failure;
+		Program program;
+		if(not failure) {
+			Compiler compiler(program, session.functions);
+			node->compile(compiler);
+			failure = compiler.failure;
+		}
+		if(failure) throw std::runtime_error(failure.describe());
+		auto &variables = session.variables;
+		if(not program.stages.empty()) {
+			for(size_t k = 0; k < inputs.size(); k++) {
+				auto elements = std::make_shared<Array<T>>(inputs[k].data, inputs[k].data + total);
+				elements->width = inputs[k].width;
+				variables.erase(Symbol(names[k]));
+				variables.arrays[Symbol(names[k])] = elements;
+			}
+			for(auto &table : tables) {
+				std::vector<std::shared_ptr<Array<T>>> arrays;
+				for(auto &name : table->names) {
+					table->column(name);
+					arrays.push_back(std::make_shared<Array<T>>());
+				}
+				while(uint64_t rows = table->read(BATCH_ROWS)) {
+					for(size_t c = 0; c < arrays.size(); c++) arrays[c]->insert(arrays[c]->end(), table->columns[c].begin(), table->columns[c].begin() + rows);
+				}
+				for(size_t c = 0; c < arrays.size(); c++) {
+					variables.erase(Symbol(table->names[c]));
+					variables.arrays[Symbol(table->names[c])] = arrays[c];
+				}
+			}
+			Value<T> value = evaluate(program, variables);
+			auto results = value.array ? value.materialize() : nullptr;
+			ColumnWriter writer(opts.output, results ? results->width : 0);
+			if(results) writer.write(results->data(), results->size());
+			else writer.write(&value.scalar, 1);
+			writer.close();
+			return 0;
+		}
+		// Where each global is read from: a binary input, a CSV column, a buffer for an
+		// assigned one, or a scalar variable. Binary inputs that are assigned are copied,
+		// since the mappings are read-only, and other assigned variables start every block
+		// as their old value spread over the elements. CSV columns are written in place.
+		size_t count = program.globals.size();
+		std::vector<int> sources(count, -1), fields(count, -1);
+		std::vector<T> initial(count, T(NAN));
+		std::vector<CsvReader *> owners(count, nullptr);
+		std::vector<std::vector<T>> buffers(count);
+		std::vector<Column<T>> columns(count);
+		std::vector<T *> globals(count, nullptr);
+		for(size_t k = 0; k < count; k++) {
+			auto &name = program.globals[k];
+			sources[k] = int(std::find(names.begin(), names.end(), name.name()) - names.begin());
+			if(sources[k] == int(names.size())) sources[k] = -1;
+			for(size_t t = 0; sources[k] < 0 && not owners[k] && t < tables.size(); t++) {
+				if(0 <= (fields[k] = tables[t]->column(name))) owners[k] = tables[t].get();
+			}
+			if(owners[k]) continue;
+			if(program.assigned[k]) {
+				buffers[k].resize(BATCH_ROWS);
+				if(variables.count(name)) initial[k] = variables[name];
+			}
+			else if(0 <= sources[k]);
+			else if(variables.arrays.count(name)) throw std::runtime_error("Array variables cannot be read in batch mode: " + name.name());
+			else if(variables.count(name)) globals[k] = &variables[name];
+			else throw std::runtime_error(Failure{ "Undefined variable: " + name.name(), locate(opts.batch, name) }.describe());
+		}
+		ColumnWriter writer(opts.output, width);
+		std::vector<T> results(BATCH_ROWS);
+		for(uint64_t done = 0; ; ) {
+			uint64_t rows = inputs.empty() ? BATCH_ROWS : std::min<uint64_t>(BATCH_ROWS, total - done);
+			for(size_t t = 0; t < tables.size(); t++) {
+				uint64_t read = tables[t]->read(rows);
+				if(read != rows && (t || not inputs.empty())) throw std::runtime_error("Column lengths differ in " + tables[t]->path);
+				rows = read;
+			}
+			if(not rows) break;
+			for(size_t k = 0; k < count; k++) {
+				const double *source = owners[k] ? owners[k]->columns[size_t(fields[k])].data() : 0 <= sources[k] ? inputs[size_t(sources[k])].data + done : nullptr;
+				if(source) columns[k].data = place(source, rows, program.assigned[k] && not owners[k], buffers[k]);
+				else if(program.assigned[k]) {
+					std::fill(buffers[k].begin(), buffers[k].begin() + rows, initial[k]);
+					columns[k].data = buffers[k].data();
+				}
+				columns[k].size = rows;
+			}
+			sweep(program, columns.data(), globals.data(), rows, results.data());
+			writer.write(results.data(), rows);
+			done += rows;
+		}
+		for(auto &table : tables) {
+			if(table->read(1)) throw std::runtime_error("Column lengths differ in " + table->path);
+		}
+		writer.close();
+	}
+	catch(const std::exception &e) {
+		session.report(e.what());
+		return 1;
+	}
+	return 0;
+}
+
+// Big-float values are only made one expression at a time.
+int batch(Session<Lazy> &session, const Options &) {
+	session.report("Batch mode is not supported in big precision");
+	return 1;
+}
+
+// With --once, the exit status tells whether the calculation failed.
+template<class T>
+int session(Options &opts) {
+	// The reading thread must not flush std::cout under the evaluating one.
+	if(opts.jsonl) {
+		std::ios::sync_with_stdio(false);
+		std::cin.tie(nullptr);
+	}
+	Session<T> session(opts, std::cout, std::cerr);
 	for(auto optfile : opts.files){
 		std::ifstream initfile(optfile);
 		if(initfile.is_open()) {
-			process(initfile, false, variables, opts, 0);
+			process(initfile, false, session, 0);
 		}
 	}
-	process(std::cin, true, variables, opts, 0);
-	return 0;
+	if(not opts.batch.empty()) return batch(session, opts);
+	if(opts.jsonl) {
+		serve(std::cin, session);
+		return 0;
+	}
+	session.failed = false;
+	process(std::cin, true, session, 0);
+	return opts.once && session.failed ? 1 : 0;
+}
+
+int main(int argc, char **argv){
+	Options opts(argc, argv);
+	if(opts.exit) { return 0; }
+	if(opts.precision == "float") return session<float>(opts);
+	if(opts.precision == "double") return session<double>(opts);
+	if(opts.precision == "long") return session<long double>(opts);
+	if(opts.precision == "interval") return session<Interval>(opts);
+	if(opts.precision == "complex") return session<Complex>(opts);
+	if(opts.precision == "big") {
+		BigFloat::precision = int(std::ceil(opts.digits * std::log2(10.0))) + BIG_GUARD;
+		return session<Lazy>(opts);
+	}
+#ifdef HAS_FLOAT128
+	if(opts.precision == "quad") return session<__float128>(opts);
+#endif
+	std::cerr << "\033[31mError: Unknown precision " << opts.precision << "\033[0m" << std::endl;
+	return 1;
 }
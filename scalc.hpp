@@ -0,0 +1,4101 @@
+// The calculator engine: lexer, parser, compiler and evaluators. It defines as well
+// as declares, with every definition inline or a template so that any number of
+// translation units may include it: scalc.cpp for the command line tool, or
+// libscalc.cpp for programs that use the library.
+#ifndef SCALC_HPP
+#define SCALC_HPP
+
+#include <iostream>
+#include <vector>
+#include <cctype>
+#include <string>
+#include <unordered_map>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <cfloat>
+#include <type_traits>
+#include <limits>
+#include <cstdio>
+#include <cfenv>
+#include <complex>
+#include <exception>
+#include <atomic>
+#include <random>
+#include <mutex>
+#if defined(__SIZEOF_FLOAT128__) && defined(__has_include)
+#if __has_include(<quadmath.h>)
+#include <quadmath.h>
+#define HAS_FLOAT128
+#endif
+#endif
+
+#define MAX_DEPTH 128
+#define MAX_STACK 65536
+#define MAX_CALL_DEPTH 10000
+#define INLINE_LIMIT 32
+#define MEMO_ARITY 4
+#define MEMO_LIMIT 65536
+#define BATCH_SIZE 256
+#define PARALLEL_THRESHOLD 65536
+#define INTEGRATE_TOLERANCE 1e-10
+#define INTEGRATE_ROUNDS 40
+#define INTEGRATE_LIMIT 65536
+#define DIFF_ORDER 2
+#define SOLVE_ITERATIONS 100
+#define SOLVE_SAMPLES 256
+#define RANDOM_CHUNK 65536
+#define BIG_GUARD 64
+#define LAZY_DEPTH 64
+#define ARRAY_ALIGN 64
+#define ARRAY_LIMIT 100000000
+#define PRINT_LIMIT 1000
+#define MATRIX_BLOCK 64
+#define SYMBOL_BITS 8
+
+enum class TokenType {
+	NUMBER,
+	IDENTIFIER,
+	PLUS,
+	MINUS,
+	MULTIPLY,
+	DIVIDE,
+	POW,
+	LPAREN,
+	RPAREN,
+	LBRACKET,
+	RBRACKET,
+	EQUAL,
+	COMMA,
+	LESS,
+	LESS_EQUAL,
+	GREATER,
+	GREATER_EQUAL,
+	EQUAL_EQUAL,
+	NOT_EQUAL,
+	INVALID,
+	END
+};
+
+struct Token {
+	TokenType type;
+	std::string value;
+	size_t position = 0; // offset in the source
+	Token(TokenType t, std::string v = "") : type(t), value(v) {}
+};
+
+// A syntax or compile error and the offset in the source it points at, if known.
+struct Failure {
+	std::string message;
+	size_t position;
+	Failure(const std::string &m = "", size_t p = std::string::npos) : message(m), position(p) {}
+	explicit operator bool() const { return not message.empty(); }
+	std::string describe() const {
+		if(position == std::string::npos) return message;
+		return message + " at column " + std::to_string(position + 1);
+	}
+};
+
+struct Builtin;
+struct StageFunction;
+
+// An interned identifier. Equal names share one entry with an id, so symbols compare
+// and hash as integers, and the entry of a builtin's name points at the builtin.
+// Entries of the keywords last for the life of the process; those of other names are
+// counted and freed, and their ids reused, when the last symbol naming them goes.
+class Symbol {
+public:
+	struct Entry {
+		std::string name;
+		uint32_t id = 0;
+		const Builtin *builtin = nullptr;
+		const StageFunction *stage = nullptr;
+		bool permanent = false;
+		std::atomic<uint32_t> refs{ 0 };
+	};
+	Symbol() : Symbol("", 0) {}
+	Symbol(const char *name, size_t size) : entry(intern(name, size)) {}
+	explicit Symbol(const char *name) : Symbol(name, std::strlen(name)) {}
+	explicit Symbol(const std::string &name) : Symbol(name.data(), name.size()) {}
+	Symbol(const Symbol &other) : entry(other.entry) { retain(); }
+	Symbol &operator=(const Symbol &other) {
+		if(entry == other.entry) return *this;
+		other.retain();
+		release();
+		entry = other.entry;
+		return *this;
+	}
+	~Symbol() { release(); }
+	uint32_t id() const { return entry->id; }
+	const std::string &name() const { return entry->name; }
+	operator const std::string &() const { return entry->name; }
+	const Builtin *builtin() const { return entry->builtin; }
+	const StageFunction *stage() const { return entry->stage; }
+	friend bool operator==(const Symbol &a, const Symbol &b) { return a.entry == b.entry; }
+	friend bool operator!=(const Symbol &a, const Symbol &b) { return a.entry != b.entry; }
+private:
+	Entry *entry;
+	void retain() const {
+		if(not entry->permanent) entry->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+	// The last reference is dropped under the table's lock, so that interning the
+	// same name cannot revive an entry that is being freed.
+	void release() {
+		if(entry->permanent) return;
+		uint32_t refs = entry->refs.load(std::memory_order_relaxed);
+		while(refs > 1) {
+			if(entry->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed)) return;
+		}
+		drop(entry);
+	}
+	static Entry *intern(const char *name, size_t size);
+	static void drop(Entry *entry);
+};
+
+namespace std {
+template<>
+struct hash<Symbol> {
+	size_t operator()(const Symbol &symbol) const { return symbol.id(); }
+};
+}
+
+class Lexer {
+	std::string input;
+	size_t pos = 0;
+	Token scan() {
+		if(pos >= input.size()) return Token(TokenType::END);
+		char ch = input[pos];
+		if(isdigit(ch) || ch == '.') {
+			std::string num;
+			while(pos < input.size() && (isdigit(input[pos]) || input[pos] == '.')) {
+				num += input[pos++];
+			}
+			// Imaginary literal such as 2i.
+			if(pos < input.size() && input[pos] == 'i' && (pos + 1 >= input.size() || not (isalnum(input[pos + 1]) || input[pos + 1] == '_'))) {
+				num += input[pos++];
+			}
+			return Token(TokenType::NUMBER, num);
+		}
+		if(isalpha(ch)) {
+			std::string ident;
+			while(pos < input.size() && (isalnum(input[pos]) || input[pos] == '_')) {
+				ident += input[pos++];
+			}
+			return Token(TokenType::IDENTIFIER, ident);
+		}
+		pos++;
+		switch(ch) {
+			case '+': 
+				return Token(TokenType::PLUS);
+			case '-': 
+				return Token(TokenType::MINUS);
+			case '*': 
+				return Token(TokenType::MULTIPLY);
+			case '/':
+				return Token(TokenType::DIVIDE);
+			case '(':
+				return Token(TokenType::LPAREN);
+			case ')':
+				return Token(TokenType::RPAREN);
+			case '[':
+				return Token(TokenType::LBRACKET);
+			case ']':
+				return Token(TokenType::RBRACKET);
+			case '=':
+				if(pos < input.size() && input[pos] == '=') { pos++; return Token(TokenType::EQUAL_EQUAL); }
+				return Token(TokenType::EQUAL);
+			case ',':
+				return Token(TokenType::COMMA);
+			case '<':
+				if(pos < input.size() && input[pos] == '=') { pos++; return Token(TokenType::LESS_EQUAL); }
+				return Token(TokenType::LESS);
+			case '>':
+				if(pos < input.size() && input[pos] == '=') { pos++; return Token(TokenType::GREATER_EQUAL); }
+				return Token(TokenType::GREATER);
+			case '!':
+				if(pos < input.size() && input[pos] == '=') { pos++; return Token(TokenType::NOT_EQUAL); }
+				break;
+		}
+		return Token(TokenType::INVALID, std::string(1, ch));
+	}
+public:
+	Lexer(const std::string &expr) : input(expr) {}
+	// Whether text is a single identifier: a letter, then letters, digits or '_'.
+	static bool identifier(const std::string &text) {
+		if(text.empty() || not isalpha(text[0])) return false;
+		return std::all_of(text.begin(), text.end(), [](char ch) { return isalnum(ch) || ch == '_'; });
+	}
+	Token getNextToken() {
+		while(pos < input.size() && isspace(input[pos])){ pos++; }
+		size_t start = pos;
+		Token token = scan();
+		token.position = start;
+		if(token.value.empty()) token.value = input.substr(start, pos - start);
+		return token;
+	}
+};
+
+// Allocates array buffers on ARRAY_ALIGN-byte boundaries, so that the batch loops
+// over them start on a cache line. The raw pointer is kept just below the buffer.
+template<class T>
+struct Aligned {
+	using value_type = T;
+	Aligned() = default;
+	template<class U> Aligned(const Aligned<U> &) {}
+	// Default-initializes, so buffers about to be overwritten are not zeroed first.
+	template<class U, class... Args>
+	void construct(U *p, Args &&...args) { ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+	template<class U>
+	void construct(U *p) { ::new(static_cast<void *>(p)) U; }
+	T *allocate(size_t n) {
+		char *raw = static_cast<char *>(::operator new(n * sizeof(T) + ARRAY_ALIGN));
+		char *buffer = raw + ARRAY_ALIGN - reinterpret_cast<uintptr_t>(raw) % ARRAY_ALIGN;
+		reinterpret_cast<char **>(buffer)[-1] = raw;
+		return reinterpret_cast<T *>(buffer);
+	}
+	void deallocate(T *buffer, size_t) { ::operator delete(reinterpret_cast<char **>(buffer)[-1]); }
+	friend bool operator==(const Aligned &, const Aligned &) { return true; }
+	friend bool operator!=(const Aligned &, const Aligned &) { return false; }
+};
+
+// A matrix is an array stored row by row with a nonzero width, the length of its rows.
+template<class T>
+struct Array : std::vector<T, Aligned<T>> {
+	using std::vector<T, Aligned<T>>::vector;
+	uint64_t width = 0;
+};
+
+// Scalar variables by name, plus the array variables. A name is in at most one of the two.
+template<class T>
+struct Variables : std::unordered_map<Symbol, T> {
+	std::unordered_map<Symbol, std::shared_ptr<const Array<T>>> arrays;
+};
+
+// Raised when a rigorous evaluation cannot decide a result, e.g. which way a branch goes.
+struct Uncertain : public std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
+
+#define ARITHMETIC(X) \
+	X(ADD, +) \
+	X(SUB, -) \
+	X(MUL, *) \
+	X(DIV, /)
+
+#define COMPARISONS(X) \
+	X(LT, less) \
+	X(LE, lessEqual) \
+	X(GT, greater) \
+	X(GE, greaterEqual) \
+	X(EQ, equal) \
+	X(NE, notEqual)
+
+#define UNARY_BUILTINS(X) \
+	X(SIN, "sin", sin) \
+	X(COS, "cos", cos) \
+	X(TAN, "tan", tan) \
+	X(ASIN, "asin", asin) \
+	X(ACOS, "acos", acos) \
+	X(ATAN, "atan", atan) \
+	X(SINH, "sinh", sinh) \
+	X(COSH, "cosh", cosh) \
+	X(TANH, "tanh", tanh) \
+	X(ASINH, "asinh", asinh) \
+	X(ACOSH, "acosh", acosh) \
+	X(ATANH, "atanh", atanh) \
+	X(SQRT, "sqrt", sqrt) \
+	X(CBRT, "cbrt", cbrt) \
+	X(EXP, "exp", exp) \
+	X(LN, "ln", log) \
+	X(LOG10, "log10", log10) \
+	X(LOG2, "log2", log2) \
+	X(ABS, "abs", fabs) \
+	X(RE, "re", re) \
+	X(IM, "im", im) \
+	X(ARG, "arg", arg) \
+	X(CONJ, "conj", conj)
+
+#define BINARY_BUILTINS(X) \
+	X(LOG, "log", logBase) \
+	X(POW, "pow", pow) \
+	X(MOD, "mod", fmod)
+
+#define REDUCTIONS(X) \
+	X(SUM, "sum") \
+	X(PROD, "prod") \
+	X(MIN, "min") \
+	X(MAX, "max")
+
+namespace math {
+	using std::sin;
+	using std::cos;
+	using std::tan;
+	using std::asin;
+	using std::acos;
+	using std::atan;
+	using std::sinh;
+	using std::cosh;
+	using std::tanh;
+	using std::asinh;
+	using std::acosh;
+	using std::atanh;
+	using std::sqrt;
+	using std::cbrt;
+	using std::exp;
+	using std::log;
+	using std::log10;
+	using std::log2;
+	using std::fabs;
+	using std::pow;
+	using std::fmod;
+#ifdef HAS_FLOAT128
+	inline __float128 sin(__float128 x) { return sinq(x); }
+	inline __float128 cos(__float128 x) { return cosq(x); }
+	inline __float128 tan(__float128 x) { return tanq(x); }
+	inline __float128 asin(__float128 x) { return asinq(x); }
+	inline __float128 acos(__float128 x) { return acosq(x); }
+	inline __float128 atan(__float128 x) { return atanq(x); }
+	inline __float128 sinh(__float128 x) { return sinhq(x); }
+	inline __float128 cosh(__float128 x) { return coshq(x); }
+	inline __float128 tanh(__float128 x) { return tanhq(x); }
+	inline __float128 asinh(__float128 x) { return asinhq(x); }
+	inline __float128 acosh(__float128 x) { return acoshq(x); }
+	inline __float128 atanh(__float128 x) { return atanhq(x); }
+	inline __float128 sqrt(__float128 x) { return sqrtq(x); }
+	inline __float128 cbrt(__float128 x) { return cbrtq(x); }
+	inline __float128 exp(__float128 x) { return expq(x); }
+	inline __float128 log(__float128 x) { return logq(x); }
+	inline __float128 log10(__float128 x) { return log10q(x); }
+	inline __float128 log2(__float128 x) { return log2q(x); }
+	inline __float128 fabs(__float128 x) { return fabsq(x); }
+	inline __float128 pow(__float128 x, __float128 y) { return powq(x, y); }
+	inline __float128 fmod(__float128 x, __float128 y) { return fmodq(x, y); }
+#endif
+	template<class T>
+	T logBase(T base, T x) {
+		return log(x) / log(base);
+	}
+	template<class T> T less(const T &a, const T &b) { return T(a < b); }
+	template<class T> T lessEqual(const T &a, const T &b) { return T(a <= b); }
+	template<class T> T greater(const T &a, const T &b) { return T(a > b); }
+	template<class T> T greaterEqual(const T &a, const T &b) { return T(a >= b); }
+	template<class T> T equal(const T &a, const T &b) { return T(a == b); }
+	template<class T> T notEqual(const T &a, const T &b) { return T(a != b); }
+	template<class T> bool isZero(const T &x) { return x == T(0); }
+	template<class T> T minimum(const T &a, const T &b) { return b < a ? b : a; }
+	// Real numbers as complex numbers on the real axis.
+	template<class T> T re(const T &x) { return x; }
+	template<class T> T im(const T &) { return T(0); }
+	template<class T> T conj(const T &x) { return x; }
+	template<class T> T arg(const T &x) {
+		if(x < T(0)) return acos(T(-1));
+		return x >= T(0) ? T(0) : x;
+	}
+	template<class T> T maximum(const T &a, const T &b) { return b > a ? b : a; }
+	// Types whose results are guaranteed bounds rather than approximations.
+	template<class T> struct Rigorous { static const bool value = false; };
+	template<class T>
+	struct Limits {
+		static T epsilon() { return std::numeric_limits<T>::epsilon(); }
+	};
+#ifdef HAS_FLOAT128
+	template<>
+	struct Limits<__float128> {
+		static __float128 epsilon() { return std::ldexp(1.0, 1 - FLT128_MANT_DIG); }
+	};
+#endif
+}
+
+// Widest type available for parsing literals.
+#ifdef HAS_FLOAT128
+using Wide = __float128;
+inline Wide parseWide(const std::string &text) { return strtoflt128(text.c_str(), nullptr); }
+#else
+using Wide = long double;
+inline Wide parseWide(const std::string &text) { return std::strtold(text.c_str(), nullptr); }
+#endif
+
+template<class T>
+void print(std::ostream &stream, const T &value) {
+	stream << value;
+}
+
+#ifdef HAS_FLOAT128
+inline void print(std::ostream &stream, __float128 value) {
+	char buffer[128];
+	quadmath_snprintf(buffer, sizeof buffer, "%.*Qg", int(stream.precision()), value);
+	stream << buffer;
+}
+#endif
+
+namespace math {
+	// Unsigned integer of any size in little-endian 32-bit limbs, without leading zero limbs.
+	struct Natural {
+		std::vector<uint32_t> limbs;
+		Natural(uint64_t x = 0) {
+			for(; x; x >>= 32) limbs.push_back(uint32_t(x));
+		}
+		bool zero() const { return limbs.empty(); }
+		size_t bits() const {
+			if(limbs.empty()) return 0;
+			size_t n = 32 * (limbs.size() - 1);
+			for(uint32_t top = limbs.back(); top; top >>= 1) n++;
+			return n;
+		}
+		bool bit(size_t k) const {
+			return k / 32 < limbs.size() && (limbs[k / 32] >> (k % 32) & 1);
+		}
+		// True when any of the lowest k bits is set.
+		bool any(size_t k) const {
+			for(size_t i = 0; i < limbs.size() && 32 * i < k; i++) {
+				uint32_t mask = k - 32 * i >= 32 ? ~0u : (1u << (k - 32 * i)) - 1;
+				if(limbs[i] & mask) return true;
+			}
+			return false;
+		}
+		void trim() {
+			while(not limbs.empty() && limbs.back() == 0) limbs.pop_back();
+		}
+		Natural operator<<(size_t k) const {
+			Natural result;
+			if(zero()) return result;
+			size_t shift = k % 32;
+			result.limbs.assign(k / 32, 0);
+			uint32_t carry = 0;
+			for(auto limb : limbs) {
+				result.limbs.push_back(limb << shift | carry);
+				carry = shift ? limb >> (32 - shift) : 0;
+			}
+			result.limbs.push_back(carry);
+			result.trim();
+			return result;
+		}
+		Natural operator>>(size_t k) const {
+			Natural result;
+			size_t shift = k % 32;
+			for(size_t i = k / 32; i < limbs.size(); i++) {
+				uint32_t next = i + 1 < limbs.size() ? limbs[i + 1] : 0;
+				result.limbs.push_back(limbs[i] >> shift | (shift ? next << (32 - shift) : 0));
+			}
+			result.trim();
+			return result;
+		}
+		friend int compare(const Natural &a, const Natural &b) {
+			if(a.limbs.size() != b.limbs.size()) return a.limbs.size() < b.limbs.size() ? -1 : 1;
+			for(size_t i = a.limbs.size(); i-- > 0;) {
+				if(a.limbs[i] != b.limbs[i]) return a.limbs[i] < b.limbs[i] ? -1 : 1;
+			}
+			return 0;
+		}
+		friend Natural operator+(const Natural &a, const Natural &b) {
+			Natural result;
+			uint64_t carry = 0;
+			for(size_t i = 0; i < std::max(a.limbs.size(), b.limbs.size()) || carry; i++) {
+				if(i < a.limbs.size()) carry += a.limbs[i];
+				if(i < b.limbs.size()) carry += b.limbs[i];
+				result.limbs.push_back(uint32_t(carry));
+				carry >>= 32;
+			}
+			return result;
+		}
+		// Requires a >= b.
+		friend Natural operator-(Natural a, const Natural &b) {
+			a.subtract(b);
+			return a;
+		}
+		friend Natural operator*(const Natural &a, const Natural &b) {
+			Natural result;
+			if(a.zero() || b.zero()) return result;
+			result.limbs.assign(a.limbs.size() + b.limbs.size(), 0);
+			for(size_t i = 0; i < a.limbs.size(); i++) {
+				uint64_t carry = 0;
+				for(size_t j = 0; j < b.limbs.size(); j++) {
+					carry += uint64_t(a.limbs[i]) * b.limbs[j] + result.limbs[i + j];
+					result.limbs[i + j] = uint32_t(carry);
+					carry >>= 32;
+				}
+				result.limbs[i + b.limbs.size()] = uint32_t(carry);
+			}
+			result.trim();
+			return result;
+		}
+		void subtract(const Natural &b) {
+			int64_t borrow = 0;
+			for(size_t i = 0; i < limbs.size(); i++) {
+				int64_t d = int64_t(limbs[i]) - borrow - (i < b.limbs.size() ? int64_t(b.limbs[i]) : 0);
+				borrow = d < 0;
+				limbs[i] = uint32_t(d);
+			}
+			trim();
+		}
+		// this = this * factor + addend
+		void scale(uint32_t factor, uint32_t addend) {
+			uint64_t carry = addend;
+			for(auto &limb : limbs) {
+				carry += uint64_t(limb) * factor;
+				limb = uint32_t(carry);
+				carry >>= 32;
+			}
+			if(carry) limbs.push_back(uint32_t(carry));
+		}
+		// Divides in place by a single limb and returns the remainder.
+		uint32_t divide(uint32_t divisor) {
+			uint64_t rest = 0;
+			for(size_t i = limbs.size(); i-- > 0;) {
+				rest = rest << 32 | limbs[i];
+				limbs[i] = uint32_t(rest / divisor);
+				rest %= divisor;
+			}
+			trim();
+			return uint32_t(rest);
+		}
+		// Schoolbook long division (Knuth's algorithm D).
+		friend void divide(const Natural &a, const Natural &b, Natural &quotient, Natural &remainder) {
+			if(compare(a, b) < 0) {
+				quotient = Natural();
+				remainder = a;
+				return;
+			}
+			if(b.limbs.size() == 1) {
+				quotient = a;
+				remainder = Natural(quotient.divide(b.limbs[0]));
+				return;
+			}
+			// Scale so the divisor's top limb has its high bit set, which keeps each quotient estimate within 2 of the truth.
+			size_t shift = 32 * b.limbs.size() - b.bits(), n = b.limbs.size(), m = a.limbs.size() - n;
+			Natural u = a << shift, v = b << shift;
+			u.limbs.resize(a.limbs.size() + 1, 0);
+			quotient.limbs.assign(m + 1, 0);
+			const uint64_t base = uint64_t(1) << 32;
+			for(size_t j = m + 1; j-- > 0;) {
+				uint64_t top = uint64_t(u.limbs[j + n]) << 32 | u.limbs[j + n - 1];
+				uint64_t estimate = top / v.limbs[n - 1], rest = top % v.limbs[n - 1];
+				while(estimate >= base || estimate * v.limbs[n - 2] > (rest << 32 | u.limbs[j + n - 2])) {
+					estimate--;
+					rest += v.limbs[n - 1];
+					if(rest >= base) break;
+				}
+				int64_t borrow = 0;
+				uint64_t carry = 0;
+				for(size_t i = 0; i < n; i++) {
+					carry += estimate * v.limbs[i];
+					int64_t d = int64_t(u.limbs[i + j]) - borrow - int64_t(carry & 0xffffffffu);
+					u.limbs[i + j] = uint32_t(d);
+					borrow = d < 0;
+					carry >>= 32;
+				}
+				int64_t d = int64_t(u.limbs[j + n]) - borrow - int64_t(carry);
+				u.limbs[j + n] = uint32_t(d);
+				if(d < 0) {
+					estimate--;
+					uint64_t sum = 0;
+					for(size_t i = 0; i < n; i++) {
+						sum += uint64_t(u.limbs[i + j]) + v.limbs[i];
+						u.limbs[i + j] = uint32_t(sum);
+						sum >>= 32;
+					}
+					u.limbs[j + n] += uint32_t(sum);
+				}
+				quotient.limbs[j] = uint32_t(estimate);
+			}
+			quotient.trim();
+			u.trim();
+			remainder = u >> shift;
+		}
+		static Natural power(uint32_t base, uint64_t n) {
+			Natural result(1), square(base);
+			for(; n; n >>= 1) {
+				if(n & 1) result = result * square;
+				if(n > 1) square = square * square;
+			}
+			return result;
+		}
+		// The digits of a decimal literal such as 12.50 as an integer, 1250, and the
+		// number of them after the point, 2.
+		static Natural parse(const std::string &text, uint64_t &scale) {
+			Natural digits;
+			scale = 0;
+			bool point = false;
+			for(char ch : text) {
+				if(ch == '.') {
+					if(point) break;
+					point = true;
+					continue;
+				}
+				if(not isdigit(ch)) break;
+				digits.scale(10, uint32_t(ch - '0'));
+				if(point) scale++;
+			}
+			digits.trim();
+			return digits;
+		}
+		std::string decimal() const {
+			if(zero()) return "0";
+			std::string text;
+			Natural rest = *this;
+			while(not rest.zero()) {
+				uint32_t chunk = rest.divide(1000000000);
+				for(int i = 0; i < 9; i++, chunk /= 10) text += char('0' + chunk % 10);
+			}
+			while(text.size() > 1 && text.back() == '0') text.pop_back();
+			std::reverse(text.begin(), text.end());
+			return text;
+		}
+	};
+
+	// Whether the decimal literal text is exactly the double value.
+	inline bool exactly(const std::string &text, double value) {
+		if(not std::isfinite(value)) return false;
+		uint64_t scale;
+		Natural digits = Natural::parse(text, scale);
+		int exponent;
+		Natural mantissa(uint64_t(std::ldexp(std::frexp(value, &exponent), 53)));
+		exponent -= 53;
+		// digits / 10^scale == mantissa * 2^exponent, with both sides made integers.
+		Natural left = exponent < 0 ? digits << size_t(-exponent) : digits;
+		Natural right = (exponent > 0 ? mantissa << size_t(exponent) : mantissa) * Natural::power(10, scale);
+		return compare(left, right) == 0;
+	}
+
+	// Binary floating point with a precision chosen at run time. A finite value is
+	// (-1)^negative * mantissa * 2^exponent, rounded to nearest at bits() bits.
+	// Functions raise `extra` to carry guard bits and round once at the end.
+	// The precision settings of BigFloat. A template, so that the header defines them.
+	template<class = void>
+	struct Precision {
+		static int precision;
+		static thread_local int extra;
+	};
+	template<class V> int Precision<V>::precision = 64;
+	template<class V> thread_local int Precision<V>::extra = 0;
+
+	struct BigFloat : Precision<> {
+		enum class Kind : unsigned char { FINITE, INFINITE, NOT_A_NUMBER };
+		Kind kind = Kind::FINITE;
+		bool negative = false;
+		int64_t exponent = 0;
+		Natural mantissa;
+		static int bits() { return precision + extra; }
+
+		BigFloat() {}
+		BigFloat(int x) : BigFloat(double(x)) {}
+		BigFloat(double x) {
+			if(std::isnan(x)) kind = Kind::NOT_A_NUMBER;
+			else if(std::isinf(x)) {
+				kind = Kind::INFINITE;
+				negative = x < 0;
+			}
+			else if(x != 0) {
+				int e;
+				double m = std::frexp(std::fabs(x), &e);
+				negative = x < 0;
+				mantissa = Natural(uint64_t(std::ldexp(m, 53)));
+				exponent = e - 53;
+				round(bits());
+			}
+		}
+		// Exact up to bits(): a wide value is the sum of at most a few doubles.
+		BigFloat(Wide x) : BigFloat(double(x)) {
+			if(kind != Kind::FINITE) return;
+			for(Wide rest = x - Wide(double(x)); rest != 0; rest -= Wide(double(rest))) *this = *this + BigFloat(double(rest));
+		}
+		static BigFloat infinity(bool negative) {
+			BigFloat x;
+			x.kind = Kind::INFINITE;
+			x.negative = negative;
+			return x;
+		}
+		static BigFloat nan() {
+			BigFloat x;
+			x.kind = Kind::NOT_A_NUMBER;
+			return x;
+		}
+		static BigFloat finite(bool negative, Natural mantissa, int64_t exponent, bool sticky = false) {
+			BigFloat x;
+			x.negative = negative;
+			x.mantissa = std::move(mantissa);
+			x.exponent = exponent;
+			x.round(bits(), sticky);
+			return x;
+		}
+		// Parses the digits and decimal point the lexer accepts, correctly rounded.
+		static BigFloat parse(const std::string &text) {
+			uint64_t scale;
+			Natural digits = Natural::parse(text, scale);
+			Natural denominator = Natural::power(10, scale), quotient, remainder;
+			size_t shift = size_t(bits()) + 2 + denominator.bits();
+			divide(digits << shift, denominator, quotient, remainder);
+			return finite(false, quotient, -int64_t(shift), not remainder.zero());
+		}
+
+		bool isNan() const { return kind == Kind::NOT_A_NUMBER; }
+		bool isInfinite() const { return kind == Kind::INFINITE; }
+		bool zero() const { return kind == Kind::FINITE && mantissa.zero(); }
+		// |x| lies in [2^(magnitude - 1), 2^magnitude).
+		int64_t magnitude() const { return exponent + int64_t(mantissa.bits()); }
+		bool integral() const {
+			return kind == Kind::FINITE && (exponent >= 0 || not mantissa.any(size_t(-exponent)));
+		}
+		// Rounds the mantissa to nearest, ties to even, at n bits. `sticky` marks nonzero bits already dropped.
+		void round(int n, bool sticky = false) {
+			size_t length = mantissa.bits();
+			if(length == 0) {
+				negative = false;
+				exponent = 0;
+				return;
+			}
+			if(length <= size_t(n)) return;
+			size_t shift = length - n;
+			bool half = mantissa.bit(shift - 1);
+			sticky = sticky || mantissa.any(shift - 1);
+			mantissa = mantissa >> shift;
+			exponent += int64_t(shift);
+			if(half && (sticky || mantissa.bit(0))) {
+				mantissa = mantissa + Natural(1);
+				if(mantissa.bits() > size_t(n)) {
+					mantissa = mantissa >> 1;
+					exponent++;
+				}
+			}
+		}
+		explicit operator double() const {
+			if(isNan()) return NAN;
+			if(isInfinite()) return negative ? -INFINITY : INFINITY;
+			if(zero()) return 0.0;
+			BigFloat x = *this;
+			x.round(53);
+			if(x.magnitude() > DBL_MAX_EXP) return negative ? -INFINITY : INFINITY;
+			if(x.magnitude() < DBL_MIN_EXP - DBL_MANT_DIG) return negative ? -0.0 : 0.0;
+			uint64_t m = x.mantissa.limbs[0];
+			if(x.mantissa.limbs.size() > 1) m |= uint64_t(x.mantissa.limbs[1]) << 32;
+			double value = std::ldexp(double(m), int(x.exponent));
+			return negative ? -value : value;
+		}
+		// Same layout as printf's %.*g.
+		std::string format(int digits) const {
+			if(isNan()) return "nan";
+			if(isInfinite()) return negative ? "-inf" : "inf";
+			if(zero()) return "0";
+			digits = std::max(digits, 1);
+			int64_t point = int64_t(std::floor(double(magnitude() - 1) * 0.30102999566398120));
+			Natural lowest = Natural::power(10, digits - 1), highest = Natural::power(10, digits), scaled;
+			for(;;) {
+				int64_t k = digits - 1 - point;
+				Natural numerator = mantissa, denominator(1), remainder;
+				if(exponent >= 0) numerator = numerator << size_t(exponent);
+				else denominator = denominator << size_t(-exponent);
+				if(k >= 0) numerator = numerator * Natural::power(10, k);
+				else denominator = denominator * Natural::power(10, -k);
+				divide(numerator, denominator, scaled, remainder);
+				int order = compare(remainder << 1, denominator);
+				if(order > 0 || (order == 0 && scaled.bit(0))) scaled = scaled + Natural(1);
+				if(compare(scaled, highest) >= 0) point++;
+				else if(compare(scaled, lowest) < 0) point--;
+				else break;
+			}
+			std::string text = scaled.decimal(), result = negative ? "-" : "";
+			if(point < -4 || point >= digits) {
+				std::string fraction = text.substr(1);
+				while(not fraction.empty() && fraction.back() == '0') fraction.pop_back();
+				std::string power = std::to_string(point < 0 ? -point : point);
+				if(power.size() < 2) power = "0" + power;
+				return result + text[0] + (fraction.empty() ? "" : "." + fraction) + (point < 0 ? "e-" : "e+") + power;
+			}
+			std::string whole = point >= 0 ? text.substr(0, size_t(point) + 1) : "0";
+			std::string fraction = point >= 0 ? text.substr(size_t(point) + 1) : std::string(size_t(-point - 1), '0') + text;
+			while(not fraction.empty() && fraction.back() == '0') fraction.pop_back();
+			return result + whole + (fraction.empty() ? "" : "." + fraction);
+		}
+
+		BigFloat operator-() const {
+			BigFloat x = *this;
+			if(not x.zero()) x.negative = not x.negative;
+			return x;
+		}
+		friend BigFloat operator+(const BigFloat &a, const BigFloat &b) {
+			if(a.isNan() || b.isNan()) return nan();
+			if(a.isInfinite()) return b.isInfinite() && a.negative != b.negative ? nan() : a;
+			if(b.isInfinite()) return b;
+			if(a.zero()) return finite(b.negative, b.mantissa, b.exponent);
+			if(b.zero()) return finite(a.negative, a.mantissa, a.exponent);
+			// An addend entirely below the rounding position of the other cannot change it.
+			if(a.magnitude() > b.magnitude() + bits() + 2) return finite(a.negative, a.mantissa, a.exponent);
+			if(b.magnitude() > a.magnitude() + bits() + 2) return finite(b.negative, b.mantissa, b.exponent);
+			int64_t low = std::min(a.exponent, b.exponent);
+			Natural x = a.mantissa << size_t(a.exponent - low), y = b.mantissa << size_t(b.exponent - low);
+			if(a.negative == b.negative) return finite(a.negative, x + y, low);
+			int order = compare(x, y);
+			if(order == 0) return BigFloat();
+			return order > 0 ? finite(a.negative, x - y, low) : finite(b.negative, y - x, low);
+		}
+		friend BigFloat operator-(const BigFloat &a, const BigFloat &b) { return a + -b; }
+		friend BigFloat operator*(const BigFloat &a, const BigFloat &b) {
+			if(a.isNan() || b.isNan()) return nan();
+			bool negative = a.negative != b.negative;
+			if(a.isInfinite() || b.isInfinite()) return a.zero() || b.zero() ? nan() : infinity(negative);
+			return finite(negative, a.mantissa * b.mantissa, a.exponent + b.exponent);
+		}
+		friend BigFloat operator/(const BigFloat &a, const BigFloat &b) {
+			if(a.isNan() || b.isNan() || (a.isInfinite() && b.isInfinite()) || (a.zero() && b.zero())) return nan();
+			bool negative = a.negative != b.negative;
+			if(a.isInfinite() || b.zero()) return infinity(negative);
+			if(b.isInfinite() || a.zero()) return BigFloat();
+			int64_t shift = std::max<int64_t>(0, bits() + 2 + int64_t(b.mantissa.bits()) - int64_t(a.mantissa.bits()));
+			Natural quotient, remainder;
+			divide(a.mantissa << size_t(shift), b.mantissa, quotient, remainder);
+			return finite(negative, quotient, a.exponent - b.exponent - shift, not remainder.zero());
+		}
+		BigFloat &operator+=(const BigFloat &other) { return *this = *this + other; }
+		BigFloat &operator*=(const BigFloat &other) { return *this = *this * other; }
+		// Total order on non-NaN values.
+		friend int compare(const BigFloat &a, const BigFloat &b) {
+			auto sign = [](const BigFloat &x) { return x.zero() ? 0 : x.negative ? -1 : 1; };
+			auto infinite = [](const BigFloat &x) { return x.isInfinite() ? (x.negative ? -1 : 1) : 0; };
+			if(infinite(a) != infinite(b)) return infinite(a) < infinite(b) ? -1 : 1;
+			if(infinite(a)) return 0;
+			if(sign(a) != sign(b)) return sign(a) < sign(b) ? -1 : 1;
+			if(sign(a) == 0) return 0;
+			if(a.magnitude() != b.magnitude()) return a.magnitude() < b.magnitude() ? -sign(a) : sign(a);
+			int64_t low = std::min(a.exponent, b.exponent);
+			return compare(a.mantissa << size_t(a.exponent - low), b.mantissa << size_t(b.exponent - low)) * sign(a);
+		}
+		friend bool operator<(const BigFloat &a, const BigFloat &b) { return not a.isNan() && not b.isNan() && compare(a, b) < 0; }
+		friend bool operator<=(const BigFloat &a, const BigFloat &b) { return not a.isNan() && not b.isNan() && compare(a, b) <= 0; }
+		friend bool operator>(const BigFloat &a, const BigFloat &b) { return b < a; }
+		friend bool operator>=(const BigFloat &a, const BigFloat &b) { return b <= a; }
+		friend bool operator==(const BigFloat &a, const BigFloat &b) { return not a.isNan() && not b.isNan() && compare(a, b) == 0; }
+		friend bool operator!=(const BigFloat &a, const BigFloat &b) { return not (a == b); }
+	};
+
+	// Raises the working precision of this thread while in scope.
+	struct Extra {
+		int saved;
+		Extra(int64_t bits) : saved(BigFloat::extra) { BigFloat::extra += int(bits); }
+		~Extra() { BigFloat::extra = saved; }
+	};
+
+	// Runs f with BIG_GUARD more bits, plus `more`, and rounds its result to the caller's precision.
+	template<class F>
+	BigFloat guarded(F f, int64_t more = 0) {
+		BigFloat result;
+		{
+			Extra extra(BIG_GUARD + std::max<int64_t>(0, more));
+			result = f();
+		}
+		result.round(BigFloat::bits());
+		return result;
+	}
+
+	inline BigFloat scaled(BigFloat x, int64_t power) {
+		if(x.kind == BigFloat::Kind::FINITE && not x.zero()) x.exponent += power;
+		return x;
+	}
+
+	inline BigFloat floor(const BigFloat &x) {
+		if(x.kind != BigFloat::Kind::FINITE || x.exponent >= 0) return x;
+		size_t shift = size_t(-x.exponent);
+		bool fraction = x.mantissa.any(shift);
+		Natural whole = x.mantissa >> shift;
+		if(x.negative && fraction) whole = whole + Natural(1);
+		return BigFloat::finite(x.negative, whole, 0);
+	}
+
+	// sum of z^(2k+1) / (2k+1), alternating in sign unless hyperbolic: atan(z) or atanh(z).
+	inline BigFloat arctangentSeries(const BigFloat &z, bool hyperbolic) {
+		BigFloat square = z * z, power = z, sum = z;
+		for(int k = 1; ; k++) {
+			power = power * square;
+			BigFloat term = power / BigFloat(2 * k + 1);
+			if(term.zero() || term.magnitude() < sum.magnitude() - BigFloat::bits() - 2) break;
+			sum += hyperbolic || k % 2 == 0 ? term : -term;
+		}
+		return sum;
+	}
+
+	// Constants are kept per thread at the highest precision asked for so far.
+	template<class F>
+	BigFloat cached(BigFloat &value, int &bits, F compute) {
+		if(bits < BigFloat::bits()) {
+			value = guarded(compute);
+			bits = BigFloat::bits();
+		}
+		BigFloat x = value;
+		x.round(BigFloat::bits());
+		return x;
+	}
+	inline BigFloat pi() {
+		static thread_local BigFloat value;
+		static thread_local int bits = 0;
+		return cached(value, bits, []() -> BigFloat {
+			return BigFloat(16) * arctangentSeries(BigFloat(1) / BigFloat(5), false) - BigFloat(4) * arctangentSeries(BigFloat(1) / BigFloat(239), false);
+		});
+	}
+	inline BigFloat ln2() {
+		static thread_local BigFloat value;
+		static thread_local int bits = 0;
+		return cached(value, bits, []() -> BigFloat { return BigFloat(2) * arctangentSeries(BigFloat(1) / BigFloat(3), true); });
+	}
+
+	inline BigFloat exp(const BigFloat &x) {
+		if(x.isNan()) return x;
+		if(x.isInfinite()) return x.negative ? BigFloat() : x;
+		if(x.zero()) return BigFloat(1);
+		if(x.magnitude() > 40) return x.negative ? BigFloat() : BigFloat::infinity(false);
+		return guarded([&]() -> BigFloat {
+			// x = k ln2 + r, and exp(r) = exp(r / 256)^256 converges quickly.
+			BigFloat k = floor(x / ln2() + BigFloat(0.5));
+			BigFloat r = scaled(x - k * ln2(), -8), sum = BigFloat(1), term = BigFloat(1);
+			for(int n = 1; ; n++) {
+				term = term * r / BigFloat(n);
+				sum += term;
+				if(term.zero() || term.magnitude() < -BigFloat::bits() - 2) break;
+			}
+			for(int i = 0; i < 8; i++) sum = sum * sum;
+			return scaled(sum, int64_t(double(k)));
+		}, x.magnitude());
+	}
+	inline BigFloat log(const BigFloat &x) {
+		if(x.isNan() || (x.negative && not x.zero())) return BigFloat::nan();
+		if(x.zero()) return BigFloat::infinity(true);
+		if(x.isInfinite()) return x;
+		return guarded([&]() -> BigFloat {
+			// x = m 2^e with m in [sqrt(1/2), sqrt(2)), and log(m) = 2 atanh((m - 1) / (m + 1)).
+			int64_t e = x.magnitude();
+			BigFloat m = scaled(x, -e);
+			if(double(m) < 0.70710678118654752) {
+				m = scaled(m, 1);
+				e--;
+			}
+			return BigFloat(double(e)) * ln2() + BigFloat(2) * arctangentSeries((m - BigFloat(1)) / (m + BigFloat(1)), true);
+		});
+	}
+	inline BigFloat ln10() {
+		static thread_local BigFloat value;
+		static thread_local int bits = 0;
+		return cached(value, bits, []() -> BigFloat { return log(BigFloat(10)); });
+	}
+	inline BigFloat log10(const BigFloat &x) { return guarded([&]() -> BigFloat { return log(x) / ln10(); }); }
+	inline BigFloat log2(const BigFloat &x) { return guarded([&]() -> BigFloat { return log(x) / ln2(); }); }
+	inline BigFloat sqrt(const BigFloat &x) {
+		if(x.isNan() || (x.negative && not x.zero())) return BigFloat::nan();
+		if(x.zero() || x.isInfinite()) return x;
+		return guarded([&]() -> BigFloat {
+			int64_t half = x.magnitude() >= 0 ? x.magnitude() / 2 : (x.magnitude() - 1) / 2;
+			BigFloat y = scaled(BigFloat(std::sqrt(double(scaled(x, -2 * half)))), half);
+			for(int n = 50; n < 2 * BigFloat::bits(); n *= 2) y = scaled(y + x / y, -1);
+			return y;
+		});
+	}
+	inline BigFloat cbrt(const BigFloat &x) {
+		if(x.isNan() || x.zero() || x.isInfinite()) return x;
+		return guarded([&]() -> BigFloat {
+			int64_t third = x.magnitude() >= 0 ? x.magnitude() / 3 : (x.magnitude() - 2) / 3;
+			BigFloat y = scaled(BigFloat(std::cbrt(double(scaled(x, -3 * third)))), third);
+			for(int n = 50; n < 2 * BigFloat::bits(); n *= 2) y = (y + y + x / (y * y)) / BigFloat(3);
+			return y;
+		});
+	}
+	inline BigFloat fabs(BigFloat x) {
+		x.negative = false;
+		return x;
+	}
+
+	// x = r + quadrant pi/2 with |r| <= pi/4. Needs as many extra bits as x has integer bits.
+	inline BigFloat reduce(const BigFloat &x, int &quadrant) {
+		BigFloat half = scaled(pi(), -1);
+		BigFloat k = floor(x / half + BigFloat(0.5));
+		quadrant = 0;
+		for(int j = 0; j < 2; j++) {
+			if(k.exponent <= j && k.mantissa.bit(size_t(j - k.exponent))) quadrant |= 1 << j;
+		}
+		if(k.negative) quadrant = (4 - quadrant) % 4;
+		return x - k * half;
+	}
+	inline BigFloat sineSeries(const BigFloat &r) {
+		BigFloat square = r * r, term = r, sum = r;
+		for(int n = 2; ; n += 2) {
+			term = -term * square / BigFloat(n * (n + 1));
+			sum += term;
+			if(term.zero() || term.magnitude() < sum.magnitude() - BigFloat::bits() - 2) break;
+		}
+		return sum;
+	}
+	inline BigFloat cosineSeries(const BigFloat &r) {
+		BigFloat square = r * r, term = BigFloat(1), sum = BigFloat(1);
+		for(int n = 1; ; n += 2) {
+			term = -term * square / BigFloat(n * (n + 1));
+			sum += term;
+			if(term.zero() || term.magnitude() < -BigFloat::bits() - 2) break;
+		}
+		return sum;
+	}
+	// Arguments beyond 2^16 bits would need as many guard bits to reduce.
+	inline bool reducible(const BigFloat &x) {
+		return x.kind == BigFloat::Kind::FINITE && x.magnitude() < 65536;
+	}
+	inline BigFloat sin(const BigFloat &x) {
+		if(not reducible(x)) return BigFloat::nan();
+		if(x.zero()) return x;
+		return guarded([&]() -> BigFloat {
+			int quadrant;
+			BigFloat r = reduce(x, quadrant);
+			BigFloat value = quadrant % 2 ? cosineSeries(r) : sineSeries(r);
+			return quadrant >= 2 ? -value : value;
+		}, x.magnitude());
+	}
+	inline BigFloat cos(const BigFloat &x) {
+		if(not reducible(x)) return BigFloat::nan();
+		return guarded([&]() -> BigFloat {
+			int quadrant;
+			BigFloat r = reduce(x, quadrant);
+			BigFloat value = quadrant % 2 ? sineSeries(r) : cosineSeries(r);
+			return quadrant == 1 || quadrant == 2 ? -value : value;
+		}, x.magnitude());
+	}
+	inline BigFloat tan(const BigFloat &x) {
+		if(not reducible(x)) return BigFloat::nan();
+		if(x.zero()) return x;
+		return guarded([&]() -> BigFloat {
+			int quadrant;
+			BigFloat r = reduce(x, quadrant);
+			BigFloat s = sineSeries(r), c = cosineSeries(r);
+			return quadrant % 2 ? -c / s : s / c;
+		}, x.magnitude());
+	}
+	inline BigFloat atan(const BigFloat &x) {
+		if(x.isNan() || x.zero()) return x;
+		return guarded([&]() -> BigFloat {
+			BigFloat y = fabs(x), half = scaled(pi(), -1);
+			if(y.isInfinite()) return x.negative ? -half : half;
+			bool inverted = y > BigFloat(1);
+			if(inverted) y = BigFloat(1) / y;
+			// atan(y) = 2 atan(y / (1 + sqrt(1 + y^2))), three times brings y below 0.1.
+			for(int i = 0; i < 3; i++) y = y / (BigFloat(1) + sqrt(BigFloat(1) + y * y));
+			BigFloat value = scaled(arctangentSeries(y, false), 3);
+			if(inverted) value = half - value;
+			return x.negative ? -value : value;
+		});
+	}
+	inline BigFloat asin(const BigFloat &x) {
+		if(x.isNan() || fabs(x) > BigFloat(1)) return BigFloat::nan();
+		if(x.zero()) return x;
+		return guarded([&]() -> BigFloat {
+			if(fabs(x) == BigFloat(1)) return x.negative ? -scaled(pi(), -1) : scaled(pi(), -1);
+			return atan(x / sqrt((BigFloat(1) - x) * (BigFloat(1) + x)));
+		});
+	}
+	inline BigFloat acos(const BigFloat &x) {
+		if(x.isNan() || fabs(x) > BigFloat(1)) return BigFloat::nan();
+		return guarded([&]() -> BigFloat { return scaled(atan(sqrt((BigFloat(1) - x) / (BigFloat(1) + x))), 1); });
+	}
+	// Small arguments cancel in the formulas below; they get as many extra bits as they have leading zeros.
+	inline int64_t leading(const BigFloat &x) {
+		return x.zero() ? 0 : -x.magnitude();
+	}
+	inline BigFloat sinh(const BigFloat &x) {
+		if(x.isNan() || x.isInfinite() || x.zero()) return x;
+		return guarded([&]() -> BigFloat {
+			BigFloat e = exp(x);
+			return scaled(e - BigFloat(1) / e, -1);
+		}, leading(x));
+	}
+	inline BigFloat cosh(const BigFloat &x) {
+		if(x.isNan()) return x;
+		if(x.isInfinite()) return fabs(x);
+		return guarded([&]() -> BigFloat {
+			BigFloat e = exp(x);
+			return scaled(e + BigFloat(1) / e, -1);
+		});
+	}
+	inline BigFloat tanh(const BigFloat &x) {
+		if(x.isNan() || x.zero()) return x;
+		if(x.isInfinite() || x.magnitude() > 30) return BigFloat(x.negative ? -1 : 1);
+		return guarded([&]() -> BigFloat {
+			BigFloat e = exp(scaled(x, 1));
+			return (e - BigFloat(1)) / (e + BigFloat(1));
+		}, leading(x));
+	}
+	inline BigFloat asinh(const BigFloat &x) {
+		if(x.isNan() || x.isInfinite() || x.zero()) return x;
+		return guarded([&]() -> BigFloat {
+			BigFloat y = fabs(x), value = log(y + sqrt(y * y + BigFloat(1)));
+			return x.negative ? -value : value;
+		}, leading(x));
+	}
+	inline BigFloat acosh(const BigFloat &x) {
+		if(x.isNan() || x < BigFloat(1)) return BigFloat::nan();
+		if(x.isInfinite()) return x;
+		return guarded([&]() -> BigFloat { return log(x + sqrt((x - BigFloat(1)) * (x + BigFloat(1)))); }, leading(x - BigFloat(1)));
+	}
+	inline BigFloat atanh(const BigFloat &x) {
+		if(x.isNan() || fabs(x) > BigFloat(1)) return BigFloat::nan();
+		if(x.zero()) return x;
+		if(fabs(x) == BigFloat(1)) return BigFloat::infinity(x.negative);
+		return guarded([&]() -> BigFloat { return scaled(log((BigFloat(1) + x) / (BigFloat(1) - x)), -1); }, leading(x));
+	}
+	inline BigFloat pow(const BigFloat &x, const BigFloat &y) {
+		if(y.zero() || x == BigFloat(1)) return BigFloat(1);
+		if(x.isNan() || y.isNan()) return BigFloat::nan();
+		if(y.integral() && y.magnitude() <= 31) {
+			return guarded([&]() -> BigFloat {
+				int64_t n = int64_t(double(y));
+				BigFloat result(1), square = x;
+				for(uint64_t k = uint64_t(n < 0 ? -n : n); k; k >>= 1) {
+					if(k & 1) result = result * square;
+					if(k > 1) square = square * square;
+				}
+				return n < 0 ? BigFloat(1) / result : result;
+			}, 32);
+		}
+		if(x.negative && not x.zero()) return BigFloat::nan();
+		if(x.zero()) return y.negative ? BigFloat::infinity(false) : BigFloat();
+		// The relative error of exp(y log x) is the absolute error of y log x.
+		int64_t size = y.magnitude() + int64_t(std::log2(double(std::abs(x.magnitude()) + 1))) + 1;
+		return guarded([&]() -> BigFloat { return exp(y * log(x)); }, size);
+	}
+	inline BigFloat fmod(const BigFloat &x, const BigFloat &y) {
+		if(x.isNan() || y.isNan() || x.isInfinite() || y.zero()) return BigFloat::nan();
+		if(y.isInfinite() || x.zero() || fabs(x) < fabs(y)) return x;
+		// Exact: the remainder of the aligned mantissas.
+		int64_t low = std::min(x.exponent, y.exponent);
+		Natural quotient, remainder;
+		divide(x.mantissa << size_t(x.exponent - low), y.mantissa << size_t(y.exponent - low), quotient, remainder);
+		return BigFloat::finite(x.negative, remainder, low);
+	}
+
+	template<>
+	struct Limits<BigFloat> {
+		static BigFloat epsilon() { return scaled(BigFloat(1), 1 - BigFloat::bits()); }
+	};
+
+	// Neighbouring doubles by stepping the bit pattern, which is much cheaper than nextafter.
+	inline double up(double x) {
+		if(x == 0) return std::numeric_limits<double>::denorm_min();
+		if(std::isnan(x) || x == INFINITY) return x;
+		if(x == -INFINITY) return -DBL_MAX;
+		uint64_t bits;
+		std::memcpy(&bits, &x, sizeof bits);
+		bits += x > 0 ? 1 : -1;
+		std::memcpy(&x, &bits, sizeof bits);
+		return x;
+	}
+	inline double down(double x) { return -up(-x); }
+	// Steps n ulps away from x, downward for negative n. Covers the error of library functions.
+	inline double step(double x, int n) {
+		for(; n < 0; n++) x = down(x);
+		for(; n > 0; n--) x = up(x);
+		return x;
+	}
+	// Bounds for an exact result given its rounded value s and the sign of exact - s in error.
+	inline double lower(double s, double error) {
+		if(std::isinf(s)) return s > 0 ? DBL_MAX : s;
+		return error < 0 ? down(s) : s;
+	}
+	inline double upper(double s, double error) {
+		if(std::isinf(s)) return s < 0 ? -DBL_MAX : s;
+		return error > 0 ? up(s) : s;
+	}
+
+	// Closed interval enclosing the exact value. The basic operations find the exact
+	// rounding error of each endpoint with an error-free transformation, so they only
+	// widen when the result is inexact; library functions widen by LIBRARY_ULPS.
+	struct Interval {
+		static const int LIBRARY_ULPS = 4;
+		double lo, hi;
+		Interval(double x = 0.0) : lo(x), hi(x) {}
+		Interval(double l, double h) : lo(l), hi(h) {}
+		bool isNan() const { return std::isnan(lo) || std::isnan(hi); }
+		explicit operator double() const {
+			if(lo != hi) throw Uncertain("Value is not exact");
+			return lo;
+		}
+		Interval operator-() const { return Interval(-hi, -lo); }
+		friend Interval operator+(const Interval &a, const Interval &b) {
+			auto error = [](double x, double y, double s) {
+				double z = s - x;
+				return (x - (s - z)) + (y - z);
+			};
+			double lo = a.lo + b.lo, hi = a.hi + b.hi;
+			return Interval(lower(lo, error(a.lo, b.lo, lo)), upper(hi, error(a.hi, b.hi, hi)));
+		}
+		friend Interval operator-(const Interval &a, const Interval &b) { return a + -b; }
+		// Rounded product of two endpoints, downward or upward.
+		static double product(double x, double y, bool upward) {
+			if(x == 0 || y == 0) return 0.0;
+			double p = x * y;
+			// Below this the error of p is no longer a double.
+			if(std::fabs(p) < DBL_MIN * 9007199254740992.0) return upward ? up(p) : down(p);
+			double e = std::fma(x, y, -p);
+			return upward ? upper(p, e) : lower(p, e);
+		}
+		static double quotient(double x, double y, bool upward) {
+			if(x == 0 || std::isinf(y)) return 0.0;
+			double q = x / y;
+			if(not std::isfinite(q) || std::fabs(q) < DBL_MIN * 9007199254740992.0) return upward ? up(q) : down(q);
+			// x = q y + r exactly, so x / y - q has the sign of r / y.
+			double r = std::fma(-q, y, x), e = y > 0 ? r : -r;
+			return upward ? upper(q, e) : lower(q, e);
+		}
+		// The signs of the operands pick the two endpoint pairs that bound the result,
+		// except when both straddle zero.
+		friend Interval operator*(const Interval &a, const Interval &b) {
+			if(a.isNan() || b.isNan()) return Interval(NAN);
+			double l1, l2, h1, h2;
+			if(a.lo >= 0) {
+				if(b.lo >= 0) { l1 = a.lo; l2 = b.lo; h1 = a.hi; h2 = b.hi; }
+				else if(b.hi <= 0) { l1 = a.hi; l2 = b.lo; h1 = a.lo; h2 = b.hi; }
+				else { l1 = a.hi; l2 = b.lo; h1 = a.hi; h2 = b.hi; }
+			}
+			else if(a.hi <= 0) {
+				if(b.lo >= 0) { l1 = a.lo; l2 = b.hi; h1 = a.hi; h2 = b.lo; }
+				else if(b.hi <= 0) { l1 = a.hi; l2 = b.hi; h1 = a.lo; h2 = b.lo; }
+				else { l1 = a.lo; l2 = b.hi; h1 = a.lo; h2 = b.lo; }
+			}
+			else {
+				if(b.lo >= 0) { l1 = a.lo; l2 = b.hi; h1 = a.hi; h2 = b.hi; }
+				else if(b.hi <= 0) { l1 = a.hi; l2 = b.lo; h1 = a.lo; h2 = b.lo; }
+				else {
+					return Interval(std::min(product(a.lo, b.hi, false), product(a.hi, b.lo, false)),
+						std::max(product(a.lo, b.lo, true), product(a.hi, b.hi, true)));
+				}
+			}
+			return Interval(product(l1, l2, false), product(h1, h2, true));
+		}
+		friend Interval operator/(const Interval &a, const Interval &b) {
+			if(a.isNan() || b.isNan()) return Interval(NAN);
+			if(b.lo <= 0 && 0 <= b.hi) return Interval(-INFINITY, INFINITY);
+			double l1, l2, h1, h2;
+			if(b.lo > 0) {
+				if(a.lo >= 0) { l1 = a.lo; l2 = b.hi; h1 = a.hi; h2 = b.lo; }
+				else if(a.hi <= 0) { l1 = a.lo; l2 = b.lo; h1 = a.hi; h2 = b.hi; }
+				else { l1 = a.lo; l2 = b.lo; h1 = a.hi; h2 = b.lo; }
+			}
+			else {
+				if(a.lo >= 0) { l1 = a.hi; l2 = b.hi; h1 = a.lo; h2 = b.lo; }
+				else if(a.hi <= 0) { l1 = a.hi; l2 = b.lo; h1 = a.lo; h2 = b.hi; }
+				else { l1 = a.hi; l2 = b.hi; h1 = a.lo; h2 = b.hi; }
+			}
+			return Interval(quotient(l1, l2, false), quotient(h1, h2, true));
+		}
+		Interval &operator+=(const Interval &other) { return *this = *this + other; }
+		Interval &operator*=(const Interval &other) { return *this = *this * other; }
+		// Certain comparisons, for generic code that only needs a consistent order.
+		friend bool operator<(const Interval &a, const Interval &b) { return a.hi < b.lo; }
+		friend bool operator<=(const Interval &a, const Interval &b) { return a.hi <= b.lo; }
+		friend bool operator>(const Interval &a, const Interval &b) { return b < a; }
+		friend bool operator>=(const Interval &a, const Interval &b) { return b <= a; }
+		friend bool operator==(const Interval &a, const Interval &b) { return a.lo == a.hi && b.lo == b.hi && a.lo == b.lo; }
+		friend bool operator!=(const Interval &a, const Interval &b) { return not (a == b); }
+	};
+
+	inline Interval increasing(double (*f)(double), const Interval &x) {
+		return Interval(step(f(x.lo), -Interval::LIBRARY_ULPS), step(f(x.hi), Interval::LIBRARY_ULPS));
+	}
+	inline Interval decreasing(double (*f)(double), const Interval &x) {
+		return Interval(step(f(x.hi), -Interval::LIBRARY_ULPS), step(f(x.lo), Interval::LIBRARY_ULPS));
+	}
+	// NaN when x is certainly outside [min, max], like the double functions.
+	inline bool inside(const Interval &x, double min, double max) {
+		if(x.isNan()) return false;
+		if(min <= x.lo && x.hi <= max) return true;
+		if(x.hi < min || max < x.lo) return false;
+		throw Uncertain("Argument may be outside the domain");
+	}
+	// Whether x may contain k pi/2 for some k = residue (mod 4). Extra candidates only loosen the bound.
+	inline bool reaches(const Interval &x, int residue) {
+		static const double half = std::acos(0.0);
+		double a = x.lo / half, b = x.hi / half;
+		if(not (b - a < 4) || std::fabs(a) > 1e15) return true;
+		double margin = 1e-12 * (std::fabs(a) + std::fabs(b) + 1);
+		for(double k = std::ceil(a - margin); k <= std::floor(b + margin); k++) {
+			if(int(k - 4 * std::floor(k / 4)) == residue) return true;
+		}
+		return false;
+	}
+	inline Interval sin(const Interval &x) {
+		if(not std::isfinite(x.lo) || not std::isfinite(x.hi)) return Interval(NAN);
+		double a = std::sin(x.lo), b = std::sin(x.hi);
+		double lo = reaches(x, 3) ? -1.0 : std::max(-1.0, step(std::min(a, b), -Interval::LIBRARY_ULPS));
+		double hi = reaches(x, 1) ? 1.0 : std::min(1.0, step(std::max(a, b), Interval::LIBRARY_ULPS));
+		return Interval(lo, hi);
+	}
+	inline Interval cos(const Interval &x) {
+		if(not std::isfinite(x.lo) || not std::isfinite(x.hi)) return Interval(NAN);
+		double a = std::cos(x.lo), b = std::cos(x.hi);
+		double lo = reaches(x, 2) ? -1.0 : std::max(-1.0, step(std::min(a, b), -Interval::LIBRARY_ULPS));
+		double hi = reaches(x, 0) ? 1.0 : std::min(1.0, step(std::max(a, b), Interval::LIBRARY_ULPS));
+		return Interval(lo, hi);
+	}
+	inline Interval tan(const Interval &x) {
+		if(not std::isfinite(x.lo) || not std::isfinite(x.hi)) return Interval(NAN);
+		if(reaches(x, 1) || reaches(x, 3)) return Interval(-INFINITY, INFINITY);
+		return increasing(std::tan, x);
+	}
+	inline Interval asin(const Interval &x) { return inside(x, -1, 1) ? increasing(std::asin, x) : Interval(NAN); }
+	inline Interval acos(const Interval &x) { return inside(x, -1, 1) ? decreasing(std::acos, x) : Interval(NAN); }
+	inline Interval atan(const Interval &x) { return increasing(std::atan, x); }
+	inline Interval sinh(const Interval &x) { return increasing(std::sinh, x); }
+	inline Interval cosh(const Interval &x) {
+		if(x.lo >= 0) return increasing(std::cosh, x);
+		if(x.hi <= 0) return decreasing(std::cosh, x);
+		if(x.isNan()) return Interval(NAN);
+		return Interval(1.0, step(std::max(std::cosh(x.lo), std::cosh(x.hi)), Interval::LIBRARY_ULPS));
+	}
+	inline Interval tanh(const Interval &x) { return increasing(std::tanh, x); }
+	inline Interval asinh(const Interval &x) { return increasing(std::asinh, x); }
+	inline Interval acosh(const Interval &x) { return inside(x, 1, INFINITY) ? increasing(std::acosh, x) : Interval(NAN); }
+	inline Interval atanh(const Interval &x) { return inside(x, -1, 1) ? increasing(std::atanh, x) : Interval(NAN); }
+	inline Interval sqrt(const Interval &x) {
+		if(not inside(x, 0, INFINITY)) return Interval(NAN);
+		// s^2 - x has the sign of the rounding error of s = sqrt(x).
+		auto bound = [](double v, bool upward) -> double {
+			double s = std::sqrt(v);
+			if(std::isinf(s) || s < DBL_MIN * 9007199254740992.0) return s == 0 ? s : upward ? up(s) : down(s);
+			double r = std::fma(-s, s, v);
+			return upward ? upper(s, r) : lower(s, r);
+		};
+		return Interval(bound(x.lo, false), bound(x.hi, true));
+	}
+	inline Interval cbrt(const Interval &x) { return increasing(std::cbrt, x); }
+	inline Interval exp(const Interval &x) { return increasing(std::exp, x); }
+	inline Interval log(const Interval &x) { return inside(x, 0, INFINITY) ? increasing(std::log, x) : Interval(NAN); }
+	inline Interval log10(const Interval &x) { return inside(x, 0, INFINITY) ? increasing(std::log10, x) : Interval(NAN); }
+	inline Interval log2(const Interval &x) { return inside(x, 0, INFINITY) ? increasing(std::log2, x) : Interval(NAN); }
+	inline Interval fabs(const Interval &x) {
+		if(x.lo >= 0) return x;
+		if(x.hi <= 0) return -x;
+		if(x.isNan()) return Interval(NAN);
+		return Interval(0.0, std::max(-x.lo, x.hi));
+	}
+	inline Interval pow(const Interval &x, const Interval &y) {
+		if(y.lo == y.hi && y.lo == std::floor(y.lo) && std::fabs(y.lo) < 2147483648.0) {
+			// Integer powers by repeated multiplication stay exact where the products are.
+			auto power = [](Interval base, uint64_t n) {
+				Interval result(1.0);
+				for(; n; n >>= 1) {
+					if(n & 1) result = result * base;
+					if(n > 1) base = base * base;
+				}
+				return result;
+			};
+			int64_t n = int64_t(y.lo);
+			uint64_t k = uint64_t(n < 0 ? -n : n);
+			Interval base = k % 2 ? x : fabs(x);
+			Interval result(power(Interval(base.lo), k).lo, power(Interval(base.hi), k).hi);
+			return n < 0 ? Interval(1.0) / result : result;
+		}
+		if(not inside(x, 0, INFINITY)) return Interval(NAN);
+		return exp(y * log(x));
+	}
+	inline Interval fmod(const Interval &x, const Interval &y) {
+		if(x.lo == x.hi && y.lo == y.hi) return Interval(std::fmod(x.lo, y.lo));
+		if(x.isNan() || y.isNan() || (y.lo <= 0 && 0 <= y.hi)) return Interval(NAN);
+		Interval q = x / y;
+		if(std::trunc(q.lo) == std::trunc(q.hi)) return x - Interval(std::trunc(q.lo)) * y;
+		double size = std::max(std::fabs(y.lo), std::fabs(y.hi));
+		return Interval(x.lo >= 0 ? 0.0 : -size, x.hi <= 0 ? 0.0 : size);
+	}
+	// Comparisons give 1 or 0 when every pair of values agrees, otherwise [0, 1].
+	inline Interval truth(bool always, bool never) {
+		return always ? Interval(1.0) : never ? Interval(0.0) : Interval(0.0, 1.0);
+	}
+	inline Interval less(const Interval &a, const Interval &b) {
+		if(a.isNan() || b.isNan()) return Interval(0.0);
+		return truth(a.hi < b.lo, a.lo >= b.hi);
+	}
+	inline Interval lessEqual(const Interval &a, const Interval &b) {
+		if(a.isNan() || b.isNan()) return Interval(0.0);
+		return truth(a.hi <= b.lo, a.lo > b.hi);
+	}
+	inline Interval greater(const Interval &a, const Interval &b) { return less(b, a); }
+	inline Interval greaterEqual(const Interval &a, const Interval &b) { return lessEqual(b, a); }
+	inline Interval equal(const Interval &a, const Interval &b) {
+		if(a.isNan() || b.isNan()) return Interval(0.0);
+		return truth(a == b, a.hi < b.lo || b.hi < a.lo);
+	}
+	inline Interval notEqual(const Interval &a, const Interval &b) {
+		Interval same = equal(a, b);
+		return Interval(1.0 - same.hi, 1.0 - same.lo);
+	}
+	inline bool isZero(const Interval &x) {
+		if(x.lo == 0 && x.hi == 0) return true;
+		if(x.lo > 0 || x.hi < 0 || x.isNan()) return false;
+		throw Uncertain("Condition is uncertain");
+	}
+	inline Interval arg(const Interval &x) {
+		static const double pi = std::acos(-1.0);
+		if(x.lo >= 0 || x.isNan()) return x.isNan() ? x : Interval(0.0);
+		return Interval(x.hi < 0 ? pi : 0.0, up(pi));
+	}
+	inline Interval minimum(const Interval &a, const Interval &b) { return Interval(std::min(a.lo, b.lo), std::min(a.hi, b.hi)); }
+	inline Interval maximum(const Interval &a, const Interval &b) { return Interval(std::max(a.lo, b.lo), std::max(a.hi, b.hi)); }
+
+	template<>
+	struct Limits<Interval> {
+		static Interval epsilon() { return Interval(DBL_EPSILON); }
+	};
+	template<> struct Rigorous<Interval> { static const bool value = true; };
+
+	// The nearest double interval around a big-float value.
+	inline Interval enclose(const BigFloat &x) {
+		double value = double(x);
+		if(std::isnan(value) || BigFloat(value) == x) return Interval(value);
+		return Interval(down(value), up(value));
+	}
+}
+
+using math::BigFloat;
+using math::Interval;
+
+inline void print(std::ostream &stream, const BigFloat &value) {
+	stream << value.format(int(stream.precision()));
+}
+
+// Rounds each end outward to the requested digits, printing a single value when they agree.
+inline void print(std::ostream &stream, const Interval &value) {
+	int digits = int(stream.precision());
+	char lo[128], hi[128];
+	int mode = std::fegetround();
+	std::fesetround(FE_DOWNWARD);
+	snprintf(lo, sizeof lo, "%.*g", digits, value.lo);
+	std::fesetround(FE_UPWARD);
+	snprintf(hi, sizeof hi, "%.*g", digits, value.hi);
+	std::fesetround(mode);
+	if(std::strcmp(lo, hi) == 0) stream << lo;
+	else stream << '[' << lo << ", " << hi << ']';
+}
+
+namespace math {
+	// Value and first derivative, propagated by the chain rule through every operation.
+	template<class T>
+	struct Dual {
+		T value, derivative;
+		Dual(T v = T(0), T d = T(0)) : value(v), derivative(d) {}
+		// Constants of any type the value can be built from, e.g. int for Dual<Dual<BigFloat>>.
+		template<class U, class = typename std::enable_if<std::is_constructible<T, const U &>::value>::type>
+		Dual(const U &v) : value(T(v)), derivative(T(0)) {}
+		explicit operator double() const { return double(value); }
+		Dual operator-() const { return Dual(-value, -derivative); }
+		Dual &operator+=(const Dual &other) { return *this = *this + other; }
+		Dual &operator*=(const Dual &other) { return *this = *this * other; }
+		friend Dual operator+(const Dual &a, const Dual &b) { return Dual(a.value + b.value, a.derivative + b.derivative); }
+		friend Dual operator-(const Dual &a, const Dual &b) { return Dual(a.value - b.value, a.derivative - b.derivative); }
+		friend Dual operator*(const Dual &a, const Dual &b) { return Dual(a.value * b.value, a.derivative * b.value + a.value * b.derivative); }
+		friend Dual operator/(const Dual &a, const Dual &b) {
+			T value = a.value / b.value;
+			return Dual(value, (a.derivative - value * b.derivative) / b.value);
+		}
+		friend bool operator<(const Dual &a, const Dual &b) { return a.value < b.value; }
+		friend bool operator<=(const Dual &a, const Dual &b) { return a.value <= b.value; }
+		friend bool operator>(const Dual &a, const Dual &b) { return a.value > b.value; }
+		friend bool operator>=(const Dual &a, const Dual &b) { return a.value >= b.value; }
+		friend bool operator==(const Dual &a, const Dual &b) { return a.value == b.value; }
+		friend bool operator!=(const Dual &a, const Dual &b) { return a.value != b.value; }
+	};
+
+	template<class T> Dual<T> sin(const Dual<T> &x) { return Dual<T>(sin(x.value), cos(x.value) * x.derivative); }
+	template<class T> Dual<T> cos(const Dual<T> &x) { return Dual<T>(cos(x.value), -sin(x.value) * x.derivative); }
+	template<class T> Dual<T> tan(const Dual<T> &x) {
+		T value = tan(x.value);
+		return Dual<T>(value, (T(1) + value * value) * x.derivative);
+	}
+	template<class T> Dual<T> asin(const Dual<T> &x) { return Dual<T>(asin(x.value), x.derivative / sqrt(T(1) - x.value * x.value)); }
+	template<class T> Dual<T> acos(const Dual<T> &x) { return Dual<T>(acos(x.value), -x.derivative / sqrt(T(1) - x.value * x.value)); }
+	template<class T> Dual<T> atan(const Dual<T> &x) { return Dual<T>(atan(x.value), x.derivative / (T(1) + x.value * x.value)); }
+	template<class T> Dual<T> sinh(const Dual<T> &x) { return Dual<T>(sinh(x.value), cosh(x.value) * x.derivative); }
+	template<class T> Dual<T> cosh(const Dual<T> &x) { return Dual<T>(cosh(x.value), sinh(x.value) * x.derivative); }
+	template<class T> Dual<T> tanh(const Dual<T> &x) {
+		T value = tanh(x.value);
+		return Dual<T>(value, (T(1) - value * value) * x.derivative);
+	}
+	template<class T> Dual<T> asinh(const Dual<T> &x) { return Dual<T>(asinh(x.value), x.derivative / sqrt(x.value * x.value + T(1))); }
+	template<class T> Dual<T> acosh(const Dual<T> &x) { return Dual<T>(acosh(x.value), x.derivative / sqrt(x.value * x.value - T(1))); }
+	template<class T> Dual<T> atanh(const Dual<T> &x) { return Dual<T>(atanh(x.value), x.derivative / (T(1) - x.value * x.value)); }
+	template<class T> Dual<T> sqrt(const Dual<T> &x) {
+		T value = sqrt(x.value);
+		return Dual<T>(value, x.derivative / (T(2) * value));
+	}
+	template<class T> Dual<T> cbrt(const Dual<T> &x) {
+		T value = cbrt(x.value);
+		return Dual<T>(value, x.derivative / (T(3) * value * value));
+	}
+	template<class T> Dual<T> exp(const Dual<T> &x) {
+		T value = exp(x.value);
+		return Dual<T>(value, value * x.derivative);
+	}
+	template<class T> Dual<T> log(const Dual<T> &x) { return Dual<T>(log(x.value), x.derivative / x.value); }
+	template<class T> Dual<T> log10(const Dual<T> &x) { return Dual<T>(log10(x.value), x.derivative / (x.value * log(T(10)))); }
+	template<class T> Dual<T> log2(const Dual<T> &x) { return Dual<T>(log2(x.value), x.derivative / (x.value * log(T(2)))); }
+	template<class T> Dual<T> fabs(const Dual<T> &x) { return x.value < T(0) ? -x : x; }
+	template<class T> Dual<T> re(const Dual<T> &x) { return Dual<T>(re(x.value), re(x.derivative)); }
+	template<class T> Dual<T> im(const Dual<T> &x) { return Dual<T>(im(x.value), im(x.derivative)); }
+	template<class T> Dual<T> conj(const Dual<T> &x) { return Dual<T>(conj(x.value), conj(x.derivative)); }
+	// d arg(z) = Im(dz / z), which vanishes on the real line.
+	template<class T> Dual<T> arg(const Dual<T> &x) { return Dual<T>(arg(x.value), im(x.derivative / x.value)); }
+	template<class T> Dual<T> pow(const Dual<T> &x, const Dual<T> &y) {
+		T value = pow(x.value, y.value);
+		T derivative = y.value * pow(x.value, y.value - T(1)) * x.derivative;
+		if(y.derivative != T(0)) derivative += value * log(x.value) * y.derivative;
+		return Dual<T>(value, derivative);
+	}
+	template<class T> Dual<T> fmod(const Dual<T> &x, const Dual<T> &y) {
+		T value = fmod(x.value, y.value);
+		return Dual<T>(value, x.derivative - (x.value - value) / y.value * y.derivative);
+	}
+
+	template<class T> Dual<T> less(const Dual<T> &a, const Dual<T> &b) { return less(a.value, b.value); }
+	template<class T> Dual<T> lessEqual(const Dual<T> &a, const Dual<T> &b) { return lessEqual(a.value, b.value); }
+	template<class T> Dual<T> greater(const Dual<T> &a, const Dual<T> &b) { return greater(a.value, b.value); }
+	template<class T> Dual<T> greaterEqual(const Dual<T> &a, const Dual<T> &b) { return greaterEqual(a.value, b.value); }
+	template<class T> Dual<T> equal(const Dual<T> &a, const Dual<T> &b) { return equal(a.value, b.value); }
+	template<class T> Dual<T> notEqual(const Dual<T> &a, const Dual<T> &b) { return notEqual(a.value, b.value); }
+	template<class T> bool isZero(const Dual<T> &x) { return isZero(x.value); }
+
+	template<class T> struct Order { static const int value = 0; };
+	template<class T> struct Order<Dual<T>> { static const int value = Order<T>::value + 1; };
+	template<class T> struct Rigorous<Dual<T>> : Rigorous<T> {};
+	template<class T>
+	struct Limits<Dual<T>> {
+		static Dual<T> epsilon() { return Limits<T>::epsilon(); }
+	};
+}
+
+using math::Dual;
+
+namespace math {
+	// Complex number stored as an interleaved (re, im) pair. Arithmetic is written out
+	// rather than going through std::complex, whose multiply and divide call the
+	// out-of-line C99 Annex G helpers; this way the batch loops inline and vectorize.
+	// Library functions with branch cuts defer to std::complex.
+	struct Complex {
+		double re, im;
+		Complex(double r = 0.0, double i = 0.0) : re(r), im(i) {}
+		explicit Complex(const std::complex<double> &z) : re(z.real()), im(z.imag()) {}
+		std::complex<double> standard() const { return std::complex<double>(re, im); }
+		bool isNan() const { return std::isnan(re) || std::isnan(im); }
+		explicit operator double() const {
+			if(im != 0) throw std::runtime_error("Expected a real number");
+			return re;
+		}
+		// 0 - im keeps -x on the same side of the branch cuts as the literal x, so sqrt(-4) is 2i.
+		Complex operator-() const { return Complex(-re, 0.0 - im); }
+		friend Complex operator+(const Complex &a, const Complex &b) { return Complex(a.re + b.re, a.im + b.im); }
+		friend Complex operator-(const Complex &a, const Complex &b) { return Complex(a.re - b.re, a.im - b.im); }
+		// Real operands give real results even when one of them is infinite.
+		friend Complex operator*(const Complex &a, const Complex &b) {
+			return Complex(a.re * b.re - a.im * b.im, a.im == 0 && b.im == 0 ? 0.0 : a.re * b.im + a.im * b.re);
+		}
+		// Smith's algorithm, which avoids overflow in |b|^2.
+		friend Complex operator/(const Complex &a, const Complex &b) {
+			if(b.im == 0) return Complex(a.re / b.re, a.im == 0 ? 0.0 : a.im / b.re);
+			if(std::fabs(b.im) <= std::fabs(b.re)) {
+				double r = b.im / b.re, d = b.re + b.im * r;
+				return Complex((a.re + a.im * r) / d, (a.im - a.re * r) / d);
+			}
+			double r = b.re / b.im, d = b.re * r + b.im;
+			return Complex((a.re * r + a.im) / d, (a.im * r - a.re) / d);
+		}
+		Complex &operator+=(const Complex &other) { return *this = *this + other; }
+		Complex &operator*=(const Complex &other) { return *this = *this * other; }
+		// Ordered by the real part, so comparisons and min/max look at re only.
+		friend bool operator<(const Complex &a, const Complex &b) { return a.re < b.re; }
+		friend bool operator<=(const Complex &a, const Complex &b) { return a.re <= b.re; }
+		friend bool operator>(const Complex &a, const Complex &b) { return a.re > b.re; }
+		friend bool operator>=(const Complex &a, const Complex &b) { return a.re >= b.re; }
+		friend bool operator==(const Complex &a, const Complex &b) { return a.re == b.re && a.im == b.im; }
+		friend bool operator!=(const Complex &a, const Complex &b) { return not (a == b); }
+	};
+
+	inline Complex sin(const Complex &z) { return Complex(std::sin(z.re) * std::cosh(z.im), std::cos(z.re) * std::sinh(z.im)); }
+	inline Complex cos(const Complex &z) { return Complex(std::cos(z.re) * std::cosh(z.im), -std::sin(z.re) * std::sinh(z.im)); }
+	inline Complex tan(const Complex &z) { return Complex(std::tan(z.standard())); }
+	inline Complex asin(const Complex &z) { return Complex(std::asin(z.standard())); }
+	inline Complex acos(const Complex &z) { return Complex(std::acos(z.standard())); }
+	inline Complex atan(const Complex &z) { return Complex(std::atan(z.standard())); }
+	inline Complex sinh(const Complex &z) { return Complex(std::sinh(z.re) * std::cos(z.im), std::cosh(z.re) * std::sin(z.im)); }
+	inline Complex cosh(const Complex &z) { return Complex(std::cosh(z.re) * std::cos(z.im), std::sinh(z.re) * std::sin(z.im)); }
+	inline Complex tanh(const Complex &z) { return Complex(std::tanh(z.standard())); }
+	inline Complex asinh(const Complex &z) { return Complex(std::asinh(z.standard())); }
+	inline Complex acosh(const Complex &z) { return Complex(std::acosh(z.standard())); }
+	inline Complex atanh(const Complex &z) { return Complex(std::atanh(z.standard())); }
+	inline Complex sqrt(const Complex &z) { return Complex(std::sqrt(z.standard())); }
+	inline Complex exp(const Complex &z) {
+		double scale = std::exp(z.re);
+		if(z.im == 0) return Complex(scale, z.im);
+		return Complex(scale * std::cos(z.im), scale * std::sin(z.im));
+	}
+	inline Complex log(const Complex &z) { return Complex(std::log(std::hypot(z.re, z.im)), std::atan2(z.im, z.re)); }
+	inline Complex log10(const Complex &z) { return log(z) / Complex(std::log(10.0)); }
+	inline Complex log2(const Complex &z) { return log(z) / Complex(std::log(2.0)); }
+	// The real cube root on the real axis, like cbrt in the real modes; the principal root elsewhere.
+	inline Complex cbrt(const Complex &z) {
+		if(z.im == 0) return Complex(std::cbrt(z.re));
+		return exp(log(z) / Complex(3.0));
+	}
+	inline Complex fabs(const Complex &z) { return Complex(std::hypot(z.re, z.im)); }
+	inline Complex pow(const Complex &x, const Complex &y) {
+		if(y.im == 0 && (x.im == 0 && (x.re >= 0 || y.re == std::floor(y.re)))) return Complex(std::pow(x.re, y.re));
+		return Complex(std::pow(x.standard(), y.standard()));
+	}
+	inline Complex fmod(const Complex &x, const Complex &y) {
+		if(x.im != 0 || y.im != 0) return Complex(NAN);
+		return Complex(std::fmod(x.re, y.re));
+	}
+	inline Complex re(const Complex &z) { return Complex(z.re); }
+	inline Complex im(const Complex &z) { return Complex(z.im); }
+	inline Complex arg(const Complex &z) { return Complex(std::atan2(z.im, z.re)); }
+	inline Complex conj(const Complex &z) { return Complex(z.re, -z.im); }
+	// |z| is not holomorphic; its derivative along dz is Re(conj(z) dz) / |z|.
+	inline Dual<Complex> fabs(const Dual<Complex> &x) {
+		Complex size = fabs(x.value);
+		return Dual<Complex>(size, re(conj(x.value) * x.derivative) / size);
+	}
+
+	template<>
+	struct Limits<Complex> {
+		static Complex epsilon() { return Complex(DBL_EPSILON); }
+	};
+}
+
+using math::Complex;
+
+inline void print(std::ostream &stream, const Complex &value) {
+	int digits = int(stream.precision());
+	char re[64], im[64];
+	snprintf(re, sizeof re, "%.*g", digits, value.re);
+	snprintf(im, sizeof im, "%+.*g", digits, value.im);
+	if(value.isNan()) stream << "nan";
+	else if(value.im == 0) stream << re;
+	else if(value.re == 0) stream << (im[0] == '+' ? im + 1 : im) << 'i';
+	else stream << re << im << 'i';
+}
+
+#define OPERATOR_OPCODE(op, symbol) op,
+#define COMPARISON_OPCODE(op, fn) op,
+#define BUILTIN_OPCODE(op, name, fn) op,
+#define REDUCTION_OPCODE(op, name) op,
+
+enum class OpCode : unsigned char {
+	CONST,
+	LOAD,
+	STORE,
+	LOCAL,
+	SLIDE,
+	CALL,
+	JUMP,
+	JUMPZ,
+	NEG,
+	ARITHMETIC(OPERATOR_OPCODE)
+	COMPARISONS(COMPARISON_OPCODE)
+	UNARY_BUILTINS(BUILTIN_OPCODE)
+	BINARY_BUILTINS(BUILTIN_OPCODE)
+	REDUCTIONS(REDUCTION_OPCODE)
+	INTEGRATE,
+	DIFF,
+	ROOT,
+	NEWTON,
+	MINIMIZE,
+	RAND,
+	RANDN
+};
+
+struct Builtin {
+	const char *name;
+	size_t arity;
+	OpCode op;
+};
+
+#define UNARY_BUILTIN(op, name, fn) { name, 1, OpCode::op },
+#define BINARY_BUILTIN(op, name, fn) { name, 2, OpCode::op },
+#define REDUCTION_BUILTIN(op, name) { name, 4, OpCode::op },
+
+constexpr Builtin builtins[] = {
+	UNARY_BUILTINS(UNARY_BUILTIN)
+	BINARY_BUILTINS(BINARY_BUILTIN)
+	REDUCTIONS(REDUCTION_BUILTIN)
+	{ "integrate", 4, OpCode::INTEGRATE },
+	{ "diff", 2, OpCode::DIFF },
+	{ "solve", 4, OpCode::ROOT },
+	{ "newton", 3, OpCode::NEWTON },
+	{ "minimize", 4, OpCode::MINIMIZE },
+	{ "rand", 0, OpCode::RAND },
+	{ "randn", 0, OpCode::RANDN }
+};
+
+inline bool isReduction(OpCode op) {
+	return op == OpCode::SUM || op == OpCode::PROD || op == OpCode::MIN || op == OpCode::MAX;
+}
+
+// Instructions followed by a body that runs once per value of a loop variable.
+inline bool isLoop(OpCode op) {
+	return isReduction(op) || op == OpCode::INTEGRATE || op == OpCode::DIFF || op == OpCode::ROOT || op == OpCode::NEWTON || op == OpCode::MINIMIZE;
+}
+
+inline unsigned concurrency(uint64_t work) {
+	if(work < PARALLEL_THRESHOLD) return 1;
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Splits [0, count) into one contiguous chunk per thread and calls work(thread, first, last).
+template<class F>
+void parallel(uint64_t count, unsigned threads, F work) {
+	if(threads == 1) {
+		work(0u, uint64_t(0), count);
+		return;
+	}
+	std::vector<std::thread> pool;
+	uint64_t chunk = (count + threads - 1) / threads;
+	for(unsigned t = 0; t < threads; t++) {
+		uint64_t first = std::min(count, t * chunk), last = std::min(count, first + chunk);
+		pool.emplace_back(work, t, first, last);
+	}
+	for(auto &thread : pool) thread.join();
+}
+
+// Counter-based random numbers: draw k is the SplitMix64 hash of the seed and k, so
+// a batch computes its lanes' draws independently. Each thread takes RANDOM_CHUNK
+// counters at a time for a stream of its own; :seed starts the counters over.
+template<class = void>
+struct Random {
+	static std::atomic<uint64_t> seed, counter;
+	static std::atomic<unsigned> epoch;
+};
+template<class V> std::atomic<uint64_t> Random<V>::seed(std::random_device{}() * 0x9e3779b97f4a7c15ULL);
+template<class V> std::atomic<uint64_t> Random<V>::counter(0);
+template<class V> std::atomic<unsigned> Random<V>::epoch(0);
+
+inline void reseed(uint64_t seed) {
+	Random<>::seed = seed;
+	Random<>::counter = 0;
+	Random<>::epoch++;
+}
+
+// The first of n consecutive counters for the calling thread.
+inline uint64_t claim(int n) {
+	struct Stream {
+		uint64_t next = 0, limit = 0;
+		unsigned epoch = 0;
+	};
+	static thread_local Stream stream;
+	unsigned epoch = Random<>::epoch;
+	if(stream.epoch != epoch || stream.limit - stream.next < uint64_t(n)) {
+		stream.next = Random<>::counter.fetch_add(RANDOM_CHUNK);
+		stream.limit = stream.next + RANDOM_CHUNK;
+		stream.epoch = epoch;
+	}
+	stream.next += n;
+	return stream.next - n;
+}
+
+// Uniform on [0, 1).
+inline double uniform(uint64_t seed, uint64_t k) {
+	uint64_t z = seed + (k + 1) * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return double((z ^ (z >> 31)) >> 11) / 9007199254740992.0;
+}
+
+// Standard normal by the Box-Muller transform of draws k and k + 1.
+inline double normal(uint64_t seed, uint64_t k) {
+	static const double tau = 2.0 * std::acos(-1.0);
+	return std::sqrt(-2.0 * std::log(1.0 - uniform(seed, k))) * std::cos(tau * uniform(seed, k + 1));
+}
+
+// Constants are stored as an unevaluated sum value + tail, exact to about 106 bits.
+struct Instruction {
+	OpCode op;
+	int arg;
+	double value, tail;
+};
+
+
+struct MemoKey {
+	uint64_t bits[MEMO_ARITY];
+	bool operator==(const MemoKey &other) const {
+		return std::equal(bits, bits + MEMO_ARITY, other.bits);
+	}
+};
+
+struct MemoHash {
+	size_t operator()(const MemoKey &key) const {
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for(auto bits : key.bits) hash = (hash ^ bits) * 0x100000001b3ULL ^ (hash >> 29);
+		return size_t(hash);
+	}
+};
+
+// Results of a pure function keyed by the exact bits of its arguments.
+// The table is dropped once it holds MEMO_LIMIT entries.
+struct Memo {
+	bool enabled = false;
+	std::unordered_map<MemoKey, double, MemoHash> table;
+	template<class T>
+	bool recall(const T *, int, MemoKey &, T &) { return false; }
+	template<class T>
+	void remember(const MemoKey &, const T &) {}
+	bool recall(const double *args, int arity, MemoKey &key, double &result) {
+		std::fill(key.bits, key.bits + MEMO_ARITY, 0);
+		std::memcpy(key.bits, args, sizeof(double) * arity);
+		auto it = table.find(key);
+		if(it == table.end()) return false;
+		result = it->second;
+		return true;
+	}
+	void remember(const MemoKey &key, double result) {
+		if(MEMO_LIMIT <= table.size()) table.clear();
+		table.emplace(key, result);
+	}
+};
+
+struct Function;
+
+struct CallSite {
+	std::shared_ptr<const Function> function; // nullptr: recursive call to the function being compiled
+	std::vector<int> link; // callee global index -> caller global index
+};
+
+struct Program;
+struct ASTNode;
+
+// An array constructor, a reduction over an array or a matrix operation, whose
+// arguments are compiled as programs of their own. Stages run before the program
+// that holds them, which reads the result of stage k from the hidden global "#k".
+struct Stage {
+	enum Kind { LIST, MATRIX, LINSPACE, RANGE, REDUCE, MC, GRAD, MATMUL, SOLVE, DET, INV, TRANSPOSE } kind;
+	OpCode op; // the reduction for REDUCE
+	std::vector<std::shared_ptr<const Program>> arguments;
+};
+
+// Builtins that take or make whole arrays, and so run as stages.
+struct StageFunction {
+	const char *name;
+	Stage::Kind kind;
+	size_t minArity, maxArity;
+};
+
+constexpr StageFunction stageFunctions[] = {
+	{ "linspace", Stage::LINSPACE, 3, 3 },
+	{ "range", Stage::RANGE, 1, 3 },
+	{ "mc", Stage::MC, 2, 2 },
+	{ "grad", Stage::GRAD, 2, SIZE_MAX },
+	{ "matmul", Stage::MATMUL, 2, 2 },
+	{ "solve", Stage::SOLVE, 2, 2 },
+	{ "det", Stage::DET, 1, 1 },
+	{ "inv", Stage::INV, 1, 1 },
+	{ "transpose", Stage::TRANSPOSE, 1, 1 }
+};
+
+inline std::string stageName(Stage::Kind kind) {
+	for(auto &function : stageFunctions) {
+		if(kind == function.kind) return function.name;
+	}
+	return "array";
+}
+
+constexpr uint32_t fnv(const char *s, size_t n, uint32_t h) {
+	return n ? fnv(s + 1, n - 1, (h ^ uint8_t(*s)) * 16777619u) : h;
+}
+constexpr size_t length(const char *s) { return *s ? 1 + length(s + 1) : 0; }
+constexpr bool same(const char *a, const char *b) { return *a == *b && (*a == '\0' || same(a + 1, b + 1)); }
+
+template<size_t... I> struct Indices {};
+template<size_t N, size_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template<size_t... I> struct MakeIndices<0, I...> { using type = Indices<I...>; };
+
+// A hash that sends the Names::count fixed names to different slots out of 2^Bits,
+// and the table from slots back to names, so finding a name is one probe and one
+// compare. The seed is searched for while compiling; a name may appear twice.
+template<class Names, unsigned Bits, class = typename MakeIndices<size_t(1) << Bits>::type>
+class PerfectHash;
+
+template<class Names, unsigned Bits, size_t... Slots>
+class PerfectHash<Names, Bits, Indices<Slots...>> {
+	static constexpr uint32_t spread(uint32_t h) { return (h ^ (h >> 15)) * 2246822519u; }
+	static constexpr uint32_t slot(const char *name, size_t size, uint32_t seed) { return spread(fnv(name, size, 2166136261u ^ seed)) >> (32 - Bits); }
+	static constexpr uint32_t slot(size_t k, uint32_t seed) { return slot(Names::name(k), length(Names::name(k)), seed); }
+	static constexpr bool apart(size_t k, size_t j, uint32_t seed) {
+		return j == k || ((slot(k, seed) != slot(j, seed) || same(Names::name(k), Names::name(j))) && apart(k, j + 1, seed));
+	}
+	static constexpr bool perfect(size_t k, uint32_t seed) { return k == Names::count || (apart(k, 0, seed) && perfect(k + 1, seed)); }
+	static constexpr uint32_t search(uint32_t seed) { return perfect(0, seed) ? seed : search(seed + 1); }
+	static constexpr uint32_t seed = search(0);
+	static constexpr int first(uint32_t s, size_t k) { return k == Names::count ? -1 : slot(k, seed) == s ? int(k) : first(s, k + 1); }
+	static constexpr int8_t table[] = { int8_t(first(Slots, 0))... };
+	static_assert(Names::count < 128, "Too many names for the table");
+public:
+	// The index of the name, or -1.
+	static int find(const char *name, size_t size) {
+		int k = table[slot(name, size, seed)];
+		if(k < 0 || std::strncmp(Names::name(k), name, size) || Names::name(k)[size]) return -1;
+		return k;
+	}
+};
+
+template<class Names, unsigned Bits, size_t... Slots>
+constexpr uint32_t PerfectHash<Names, Bits, Indices<Slots...>>::seed;
+template<class Names, unsigned Bits, size_t... Slots>
+constexpr int8_t PerfectHash<Names, Bits, Indices<Slots...>>::table[];
+
+// "if", the builtins, the stage functions, then Ans, which every line assigns.
+struct Keywords {
+	static constexpr size_t builtinCount = sizeof builtins / sizeof *builtins;
+	static constexpr size_t stageCount = sizeof stageFunctions / sizeof *stageFunctions;
+	static constexpr size_t count = 2 + builtinCount + stageCount;
+	static constexpr const char *name(size_t k) {
+		return k == 0 ? "if" : k <= builtinCount ? builtins[k - 1].name
+			: k <= builtinCount + stageCount ? stageFunctions[k - 1 - builtinCount].name : "Ans";
+	}
+};
+
+// The keywords and the empty name are interned for good when the table is made and
+// found again without the lock. Other names are counted by the symbols that hold them.
+class SymbolTable {
+	std::mutex mutex;
+	std::unordered_map<std::string, Symbol::Entry> index;
+	std::vector<uint32_t> unused;
+	uint32_t next = 0;
+	Symbol::Entry *keywords[Keywords::count];
+	Symbol::Entry *empty;
+	Symbol::Entry *add(const std::string &name) {
+		auto found = index.find(name);
+		if(found != index.end()) {
+			if(not found->second.permanent) found->second.refs.fetch_add(1, std::memory_order_relaxed);
+			return &found->second;
+		}
+		auto &entry = index[name];
+		entry.name = name;
+		entry.refs.store(1, std::memory_order_relaxed);
+		if(unused.empty()) entry.id = next++;
+		else {
+			entry.id = unused.back();
+			unused.pop_back();
+		}
+		return &entry;
+	}
+	Symbol::Entry *keep(const std::string &name) {
+		auto entry = add(name);
+		entry->permanent = true;
+		return entry;
+	}
+public:
+	SymbolTable() {
+		for(size_t k = 0; k < Keywords::count; k++) keywords[k] = keep(Keywords::name(k));
+		for(size_t k = 0; k < Keywords::builtinCount; k++) keywords[1 + k]->builtin = &builtins[k];
+		for(size_t k = 0; k < Keywords::stageCount; k++) keywords[1 + Keywords::builtinCount + k]->stage = &stageFunctions[k];
+		empty = keep("");
+	}
+	Symbol::Entry *intern(const char *name, size_t size) {
+		if(size == 0) return empty;
+		int k = PerfectHash<Keywords, SYMBOL_BITS>::find(name, size);
+		if(0 <= k) return keywords[k];
+		std::lock_guard<std::mutex> lock(mutex);
+		return add(std::string(name, size));
+	}
+	void drop(Symbol::Entry *entry) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if(entry->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		unused.push_back(entry->id);
+		index.erase(index.find(entry->name));
+	}
+};
+
+inline SymbolTable &symbols() {
+	static SymbolTable table;
+	return table;
+}
+
+inline Symbol::Entry *Symbol::intern(const char *name, size_t size) {
+	return symbols().intern(name, size);
+}
+
+inline void Symbol::drop(Entry *entry) {
+	symbols().drop(entry);
+}
+
+// Postfix code for one expression or function body. Globals are bound to
+// storage when it runs, parameters live in the first `arity` stack slots.
+struct Program {
+	std::vector<Instruction> code;
+	std::vector<Symbol> globals;
+	std::vector<bool> assigned;
+	std::vector<std::string> literals; // source text of each CONST, for types wider than double-double
+	std::vector<bool> exact; // whether each literal is exactly its double value
+	std::vector<CallSite> calls;
+	std::vector<Stage> stages;
+	std::shared_ptr<Memo> memo; // nullptr: not memoizable
+	int arity = 0;
+	int depth = 0;
+	// The work of running the program once per element, to split between threads.
+	// Loops count as a batch of evaluations of their bodies.
+	uint64_t work(uint64_t elements) const {
+		uint64_t total = elements * code.size();
+		if(std::any_of(code.begin(), code.end(), [](const Instruction &instruction) { return isLoop(instruction.op); })) total *= BATCH_SIZE;
+		return total;
+	}
+};
+
+struct Function {
+	Symbol name;
+	std::vector<Symbol> params;
+	Program body;
+};
+
+using Functions = std::unordered_map<Symbol, std::shared_ptr<const Function>>;
+
+// Constants are stored as an unevaluated sum value + tail. Types wider than double
+// parse the literal text instead, since the sum keeps about 106 bits and rounding it
+// to the type would round a second time.
+template<class T>
+struct Literal {
+	static T value(const Program &, const Instruction &instruction) {
+		return T(instruction.value) + T(instruction.tail);
+	}
+};
+
+template<class T>
+T parseLiteral(const std::string &text);
+
+template<>
+inline long double parseLiteral(const std::string &text) {
+	return std::strtold(text.c_str(), nullptr);
+}
+
+#ifdef HAS_FLOAT128
+template<>
+inline __float128 parseLiteral(const std::string &text) {
+	return parseWide(text);
+}
+#endif
+
+template<class T>
+struct ParsedLiteral {
+	static T value(const Program &program, const Instruction &instruction) {
+		static thread_local std::unordered_map<std::string, T> cache;
+		auto &text = program.literals[instruction.arg];
+		if(text.back() == 'i') return T(NAN);
+		auto it = cache.find(text);
+		if(it != cache.end()) return it->second;
+		if(MEMO_LIMIT <= cache.size()) cache.clear();
+		return cache.emplace(text, parseLiteral<T>(text)).first->second;
+	}
+};
+
+template<>
+struct Literal<long double> : ParsedLiteral<long double> {};
+
+#ifdef HAS_FLOAT128
+template<>
+struct Literal<__float128> : ParsedLiteral<__float128> {};
+#endif
+
+template<>
+struct Literal<float> {
+	static float value(const Program &, const Instruction &instruction) {
+		return float(instruction.value);
+	}
+};
+
+template<>
+struct Literal<double> {
+	static double value(const Program &, const Instruction &instruction) {
+		return instruction.value;
+	}
+};
+
+// Imaginary literals such as 2i are NaN in the real types and keep their digits in the text.
+template<>
+struct Literal<Complex> {
+	static Complex value(const Program &program, const Instruction &instruction) {
+		auto &text = program.literals[instruction.arg];
+		if(text.back() == 'i') return Complex(0.0, std::strtod(text.c_str(), nullptr));
+		return Complex(instruction.value);
+	}
+};
+
+// Literals that are exactly a double are points; any other lies within an ulp of value.
+template<>
+struct Literal<Interval> {
+	static Interval value(const Program &program, const Instruction &instruction) {
+		if(program.exact[instruction.arg]) return Interval(instruction.value);
+		return Interval(math::down(instruction.value), math::up(instruction.value));
+	}
+};
+
+template<>
+struct Literal<BigFloat> {
+	static BigFloat value(const Program &program, const Instruction &instruction) {
+		static thread_local std::unordered_map<std::string, BigFloat> cache;
+		static thread_local int bits = 0;
+		if(bits != BigFloat::bits()) {
+			cache.clear();
+			bits = BigFloat::bits();
+		}
+		auto &text = program.literals[instruction.arg];
+		if(text.back() == 'i') return BigFloat::nan();
+		auto it = cache.find(text);
+		if(it != cache.end()) return it->second;
+		if(MEMO_LIMIT <= cache.size()) cache.clear();
+		return cache.emplace(text, BigFloat::parse(text)).first->second;
+	}
+};
+
+template<class T>
+struct Literal<Dual<T>> {
+	static Dual<T> value(const Program &program, const Instruction &instruction) {
+		return Dual<T>(Literal<T>::value(program, instruction));
+	}
+};
+
+template<class T>
+T constant(const Program &program, const Instruction &instruction) {
+	return Literal<T>::value(program, instruction);
+}
+
+class Compiler {
+	Program &program;
+	const Functions &functions;
+	Symbol self;
+	std::vector<std::pair<Symbol, int>> scope; // parameters and loop variables with their stack slots
+	int depth;
+	void push(int n) {
+		depth += n;
+		program.depth = std::max(program.depth, depth);
+	}
+	int site(const CallSite &callee, const std::vector<int> &link) {
+		CallSite call{ callee.function, {} };
+		for(auto k : callee.link) call.link.push_back(link[k]);
+		program.calls.push_back(std::move(call));
+		return int(program.calls.size()) - 1;
+	}
+	bool inlinable(const Function &function) {
+		if(function.body.code.size() > INLINE_LIMIT) return false;
+		if(function.body.memo && function.body.memo->enabled) return false;
+		for(auto &call : function.body.calls) {
+			if(not call.function) return false;
+		}
+		return true;
+	}
+	// Copies the body in place of the call. Parameters become the argument slots already on the stack.
+	void splice(const Function &function) {
+		auto &body = function.body;
+		int base = depth - body.arity;
+		std::vector<int> link;
+		for(size_t k = 0; k < body.globals.size(); k++) link.push_back(global(body.globals[k], body.assigned[k]));
+		for(auto instruction : body.code) {
+			switch(instruction.op) {
+				case OpCode::CONST:
+					program.literals.push_back(body.literals[instruction.arg]);
+					program.exact.push_back(body.exact[instruction.arg]);
+					instruction.arg = int(program.literals.size()) - 1;
+					break;
+				case OpCode::LOCAL:
+					instruction.arg += base;
+					break;
+				case OpCode::LOAD:
+				case OpCode::STORE:
+					instruction.arg = link[instruction.arg];
+					break;
+				case OpCode::CALL:
+					instruction.arg = site(body.calls[instruction.arg], link);
+					break;
+				default:
+					break;
+			}
+			program.code.push_back(instruction);
+		}
+		program.depth = std::max(program.depth, base + body.depth);
+		push(1);
+		if(body.arity) emit(OpCode::SLIDE, body.arity, -body.arity);
+	}
+public:
+	Failure failure; // the first error; compiling carries on, but the program is unusable
+	Compiler(Program &p, const Functions &f, Symbol s = Symbol(), const std::vector<Symbol> &params = {})
+		: program(p), functions(f), self(s), depth(0) {
+		for(auto &param : params) scope.emplace_back(param, int(scope.size()));
+		program.arity = int(params.size());
+		push(program.arity);
+	}
+	void emit(OpCode op, int arg, int effect, double value = 0.0, double tail = 0.0) {
+		program.code.push_back(Instruction{ op, arg, value, tail });
+		push(effect);
+	}
+	int global(Symbol name, bool assign = false) {
+		auto it = std::find(program.globals.begin(), program.globals.end(), name);
+		int k = int(it - program.globals.begin());
+		if(it == program.globals.end()) {
+			program.globals.push_back(name);
+			program.assigned.push_back(false);
+		}
+		if(assign) program.assigned[k] = true;
+		return k;
+	}
+	void constant(double value, double tail, const std::string &text, bool exact) {
+		program.literals.push_back(text);
+		program.exact.push_back(exact);
+		emit(OpCode::CONST, int(program.literals.size()) - 1, 1, value, tail);
+	}
+	int local(Symbol name) {
+		for(auto it = scope.rbegin(); it != scope.rend(); ++it) {
+			if(it->first == name) return it->second;
+		}
+		return -1;
+	}
+	void load(Symbol name) {
+		int slot = local(name);
+		if(0 <= slot) emit(OpCode::LOCAL, slot, 1);
+		else emit(OpCode::LOAD, global(name), 1);
+	}
+	void fail(const std::string &message, size_t position) {
+		if(not failure) failure = Failure{ message, position };
+	}
+	void store(Symbol name, size_t position = std::string::npos) {
+		if(0 <= local(name)) return fail("Cannot assign to parameter: " + name.name(), position);
+		emit(OpCode::STORE, global(name, true), 0);
+	}
+	void apply(OpCode op, int arity) {
+		emit(op, 0, 1 - arity);
+	}
+	// Emits a forward jump whose target is set by land(). Both kinds leave the
+	// compile-time depth one lower, ready for the branch that follows.
+	size_t jump(OpCode op) {
+		emit(op, 0, -1);
+		return program.code.size() - 1;
+	}
+	void land(size_t at) {
+		program.code[at].arg = int(program.code.size() - at - 1);
+	}
+	// Starts a loop over the operands on top of the stack. The body that follows
+	// sees the loop variable in the first operand's slot.
+	size_t loop(OpCode op, Symbol name, int operands) {
+		emit(op, 0, 0);
+		scope.emplace_back(name, depth - operands);
+		return program.code.size() - 1;
+	}
+	void endLoop(size_t at, int operands) {
+		scope.pop_back();
+		land(at);
+		push(-operands);
+	}
+	// Compiles the arguments as programs of their own and loads the stage's result.
+	void stage(Stage::Kind kind, OpCode op, const std::vector<ASTNode *> &arguments, size_t position);
+	// Arguments must already be compiled onto the stack.
+	void call(Symbol name, size_t argc, size_t position) {
+		if(auto builtin = name.builtin()) {
+			if(builtin->arity != argc || isLoop(builtin->op)) return fail("Unknown function: " + name.name(), position);
+			apply(builtin->op, int(argc));
+			return;
+		}
+		if(name == self) {
+			if(size_t(program.arity) != argc) return fail("Wrong number of arguments: " + name.name(), position);
+			program.calls.push_back(CallSite{ nullptr, {} });
+			emit(OpCode::CALL, int(program.calls.size()) - 1, 1 - int(argc));
+			return;
+		}
+		auto it = functions.find(name);
+		if(it == functions.end()) return fail("Unknown function: " + name.name(), position);
+		auto &function = *it->second;
+		if(function.params.size() != argc) return fail("Wrong number of arguments: " + name.name(), position);
+		if(inlinable(function)) {
+			splice(function);
+			return;
+		}
+		std::vector<int> link;
+		for(size_t k = 0; k < function.body.globals.size(); k++) link.push_back(global(function.body.globals[k], function.body.assigned[k]));
+		program.calls.push_back(CallSite{ it->second, std::move(link) });
+		emit(OpCode::CALL, int(program.calls.size()) - 1, 1 - int(argc));
+	}
+};
+
+template<class T>
+T pairwise(const T *values, int n) {
+	if(n <= 8) {
+		T sum = T(0);
+		for(int l = 0; l < n; l++) sum += values[l];
+		return sum;
+	}
+	return pairwise(values, n / 2) + pairwise(values + n / 2, n - n / 2);
+}
+
+// Running result of sum/prod/min/max. Sums use Neumaier compensation except for intervals.
+template<class T>
+struct Accumulator {
+	OpCode op;
+	T value, compensation;
+	bool empty = true;
+	Accumulator(OpCode o) : op(o), value(o == OpCode::PROD ? T(1) : T(0)), compensation(T(0)) {}
+	void add(T x) {
+		switch(op) {
+			case OpCode::SUM: {
+				// Compensation would only widen an interval, whose additions are already rounded outward.
+				if(math::Rigorous<T>::value) {
+					value += x;
+					break;
+				}
+				T sum = value + x;
+				if(math::fabs(value) >= math::fabs(x)) compensation += (value - sum) + x;
+				else compensation += (x - sum) + value;
+				value = sum;
+				break;
+			}
+			case OpCode::PROD: value *= x; break;
+			case OpCode::MIN: value = empty ? x : math::minimum(value, x); break;
+			case OpCode::MAX: value = empty ? x : math::maximum(value, x); break;
+			default: break;
+		}
+		empty = false;
+	}
+	// Adds a block of values, summing it pairwise first.
+	void absorb(const T *values, int n) {
+		if(op == OpCode::SUM) add(pairwise(values, n));
+		else for(int l = 0; l < n; l++) add(values[l]);
+	}
+	T result() const {
+		if(op == OpCode::SUM) return value + compensation;
+		if(empty && (op == OpCode::MIN || op == OpCode::MAX)) return T(NAN);
+		return value;
+	}
+};
+
+#define BATCH_OPERATOR(op, symbol) case OpCode::op: sp--; for(int l = 0; l < n; l++) row(sp - 1)[l] = row(sp - 1)[l] symbol row(sp)[l]; break;
+#define BATCH_COMPARISON(op, fn) case OpCode::op: sp--; for(int l = 0; l < n; l++) row(sp - 1)[l] = math::fn(row(sp - 1)[l], row(sp)[l]); break;
+#define BATCH_UNARY(op, name, fn) case OpCode::op: for(int l = 0; l < n; l++) row(sp - 1)[l] = math::fn(row(sp - 1)[l]); break;
+#define BATCH_BINARY(op, name, fn) case OpCode::op: sp--; for(int l = 0; l < n; l++) row(sp - 1)[l] = math::fn(row(sp - 1)[l], row(sp)[l]); break;
+
+// Count, mean and sum of squared deviations of the values seen, merged block by
+// block with Chan's update so that threads can combine their parts.
+template<class T>
+struct Moments {
+	uint64_t count = 0;
+	T mean = T(0), squares = T(0);
+	void merge(const Moments &other) {
+		if(not other.count) return;
+		double total = double(count + other.count);
+		T delta = other.mean - mean;
+		mean += delta * T(double(other.count) / total);
+		squares += other.squares + delta * math::conj(delta) * T(double(count) * double(other.count) / total);
+		count += other.count;
+	}
+	void absorb(const T *values, int n) {
+		Moments block;
+		block.count = uint64_t(n);
+		block.mean = pairwise(values, n) / T(double(n));
+		for(int l = 0; l < n; l++) block.squares += (values[l] - block.mean) * math::conj(values[l] - block.mean);
+		merge(block);
+	}
+	void add(const T &value) { absorb(&value, 1); }
+};
+
+// Where a global's elements come from when a program runs over arrays: a buffer, or
+// the arithmetic sequence of linspace or range, generated a block at a time so it
+// never needs a buffer of its own.
+template<class T>
+struct Column {
+	T *data = nullptr;
+	bool generated = false;
+	T start = T(0), step = T(0), last = T(0);
+	uint64_t size = 0;
+	bool active() const { return data || generated; }
+	T at(uint64_t k) const {
+		if(data) return data[k];
+		return k + 1 == size ? last : start + T(double(k)) * step;
+	}
+	void fill(uint64_t offset, int n, T *out) const {
+		if(data) {
+			std::copy(data + offset, data + offset + n, out);
+			return;
+		}
+		for(int l = 0; l < n; l++) out[l] = start + T(double(offset + l)) * step;
+		if(size <= offset + n) out[size - 1 - offset] = last;
+	}
+};
+
+// Evaluates straight-line code one instruction at a time over BATCH_SIZE lanes, so
+// each step is a plain loop the compiler can vectorize. Stack slot `index` takes a
+// different input in every lane, other slots below `base` are shared. Globals with
+// a column are arrays, read and written at the lanes' elements.
+template<class T>
+class Batch {
+	const Program &program;
+	size_t begin, end;
+	T *const *globals;
+	const T *frame;
+	int base, index;
+	Array<T> rows;
+	const Column<T> *columns = nullptr;
+	uint64_t offset = 0;
+	T *row(int r) { return rows.data() + size_t(r) * BATCH_SIZE; }
+public:
+	Batch(const Program &p, size_t b, size_t e, T *const *g, const T *f, int i)
+		: program(p), begin(b), end(e), globals(g), frame(f), base(i + 2), index(i),
+		rows(size_t(std::max(p.depth - i - 2, 1)) * BATCH_SIZE) {}
+	// Stores are only supported for whole programs over arrays, where every assigned global has a column.
+	static bool supports(const Program &program, size_t begin, size_t end, bool stores = false) {
+		for(size_t pc = begin; pc < end; pc++) {
+			switch(program.code[pc].op) {
+				case OpCode::STORE:
+					if(not stores) return false;
+					break;
+				case OpCode::CALL:
+				case OpCode::JUMP:
+				case OpCode::JUMPZ:
+					return false;
+				default:
+					if(isLoop(program.code[pc].op)) return false;
+			}
+		}
+		return true;
+	}
+	const T *run(const T *inputs, int n) {
+		int sp = 0;
+		for(size_t pc = begin; pc < end; pc++) {
+			auto &instruction = program.code[pc];
+			switch(instruction.op) {
+				case OpCode::CONST: std::fill(row(sp), row(sp) + n, constant<T>(program, instruction)); sp++; break;
+				case OpCode::LOAD:
+					if(columns && columns[instruction.arg].active()) columns[instruction.arg].fill(offset, n, row(sp));
+					else std::fill(row(sp), row(sp) + n, *globals[instruction.arg]);
+					sp++;
+					break;
+				case OpCode::STORE:
+					if(columns[instruction.arg].data) std::copy(row(sp - 1), row(sp - 1) + n, columns[instruction.arg].data + offset);
+					break;
+				case OpCode::LOCAL:
+					if(instruction.arg == index) std::copy(inputs, inputs + n, row(sp));
+					else if(instruction.arg < base) std::fill(row(sp), row(sp) + n, frame[instruction.arg]);
+					else std::copy(row(instruction.arg - base), row(instruction.arg - base) + n, row(sp));
+					sp++;
+					break;
+				case OpCode::SLIDE: sp -= instruction.arg; std::copy(row(sp + instruction.arg - 1), row(sp + instruction.arg - 1) + n, row(sp - 1)); break;
+				case OpCode::NEG: for(int l = 0; l < n; l++) row(sp - 1)[l] = -row(sp - 1)[l]; break;
+				case OpCode::RAND: {
+					uint64_t seed = Random<>::seed, k = claim(n);
+					for(int l = 0; l < n; l++) row(sp)[l] = T(uniform(seed, k + l));
+					sp++;
+					break;
+				}
+				case OpCode::RANDN: {
+					uint64_t seed = Random<>::seed, k = claim(2 * n);
+					for(int l = 0; l < n; l++) row(sp)[l] = T(normal(seed, k + 2 * l));
+					sp++;
+					break;
+				}
+				ARITHMETIC(BATCH_OPERATOR)
+				COMPARISONS(BATCH_COMPARISON)
+				UNARY_BUILTINS(BATCH_UNARY)
+				BINARY_BUILTINS(BATCH_BINARY)
+				default: throw std::runtime_error("Invalid batch instruction");
+			}
+		}
+		return row(sp - 1);
+	}
+	// Reduces the body over lo + first, ..., lo + last - 1.
+	Accumulator<T> reduce(OpCode op, T lo, uint64_t first, uint64_t last) {
+		Accumulator<T> acc(op);
+		T inputs[BATCH_SIZE];
+		for(uint64_t at = first; at < last; at += BATCH_SIZE) {
+			int n = int(std::min<uint64_t>(BATCH_SIZE, last - at));
+			for(int l = 0; l < n; l++) inputs[l] = lo + T(double(at + l));
+			acc.absorb(run(inputs, n), n);
+		}
+		return acc;
+	}
+	// Runs the whole program for elements [first, last) of the columns, copying the
+	// results out or, without a results buffer, reducing them into acc if there is one. Built with
+	// index -2, so that every stack slot has a row.
+	template<class Sink>
+	void elements(const Column<T> *c, uint64_t first, uint64_t last, T *results, Sink *acc) {
+		columns = c;
+		for(offset = first; offset < last; offset += BATCH_SIZE) {
+			int n = int(std::min<uint64_t>(BATCH_SIZE, last - offset));
+			const T *values = run(nullptr, n);
+			if(results) std::copy(values, values + n, results + offset);
+			else if(acc) acc->absorb(values, n);
+		}
+	}
+	void map(const T *inputs, T *outputs, size_t n) {
+		for(size_t at = 0; at < n; at += BATCH_SIZE) {
+			int count = int(std::min<size_t>(BATCH_SIZE, n - at));
+			const T *values = run(inputs + at, count);
+			std::copy(values, values + count, outputs + at);
+		}
+	}
+};
+
+#define SCALAR_OPERATOR(op, symbol) case OpCode::op: top--; top[-1] = top[-1] symbol top[0]; break;
+#define SCALAR_COMPARISON(op, fn) case OpCode::op: top--; top[-1] = math::fn(top[-1], top[0]); break;
+#define SCALAR_UNARY(op, name, fn) case OpCode::op: top[-1] = math::fn(top[-1]); break;
+#define SCALAR_BINARY(op, name, fn) case OpCode::op: top--; top[-1] = math::fn(top[-1], top[0]); break;
+
+template<class T>
+class Machine {
+	std::vector<T> stack;
+	std::vector<T *> tables;
+	size_t tableTop = 0;
+	int calls = 0;
+	// Runs code[begin, end) with the stack starting at top and returns the value left on it.
+	T execute(const Program &program, T *const *globals, T *frame, size_t begin, size_t end, T *top) {
+		for(size_t pc = begin; pc < end; pc++) {
+			auto &instruction = program.code[pc];
+			switch(instruction.op) {
+				case OpCode::CONST: *top++ = constant<T>(program, instruction); break;
+				case OpCode::LOAD: *top++ = *globals[instruction.arg]; break;
+				case OpCode::STORE: *globals[instruction.arg] = top[-1]; break;
+				case OpCode::LOCAL: *top++ = frame[instruction.arg]; break;
+				case OpCode::SLIDE: top -= instruction.arg; top[-1] = top[instruction.arg - 1]; break;
+				case OpCode::CALL: {
+					auto &site = program.calls[instruction.arg];
+					auto &callee = site.function ? site.function->body : program;
+					T *args = top - callee.arity;
+					if(args + callee.depth > stack.data() + stack.size() || tableTop + site.link.size() > tables.size() || MAX_CALL_DEPTH < ++calls) {
+						throw std::runtime_error("Stack overflow");
+					}
+					Memo *memo = callee.memo && callee.memo->enabled ? callee.memo.get() : nullptr;
+					MemoKey key;
+					if(memo && memo->recall(args, callee.arity, key, *args)) {
+						calls--;
+						top = args + 1;
+						break;
+					}
+					T *const *table = globals;
+					if(site.function) {
+						for(size_t k = 0; k < site.link.size(); k++) tables[tableTop + k] = globals[site.link[k]];
+						table = &tables[tableTop];
+						tableTop += site.link.size();
+					}
+					*args = execute(callee, table, args, 0, callee.code.size(), args + callee.arity);
+					if(site.function) tableTop -= site.link.size();
+					if(memo) memo->remember(key, *args);
+					calls--;
+					top = args + 1;
+					break;
+				}
+				case OpCode::JUMP: pc += instruction.arg; break;
+				case OpCode::JUMPZ: if(math::isZero(*--top)) pc += instruction.arg; break;
+				case OpCode::NEG: top[-1] = -top[-1]; break;
+				case OpCode::RAND: *top++ = T(uniform(Random<>::seed, claim(1))); break;
+				case OpCode::RANDN: *top++ = T(normal(Random<>::seed, claim(2))); break;
+				ARITHMETIC(SCALAR_OPERATOR)
+				COMPARISONS(SCALAR_COMPARISON)
+				UNARY_BUILTINS(SCALAR_UNARY)
+				BINARY_BUILTINS(SCALAR_BINARY)
+				case OpCode::SUM:
+				case OpCode::PROD:
+				case OpCode::MIN:
+				case OpCode::MAX:
+					top[-2] = reduce(program, globals, frame, pc, top - 2);
+					top--;
+					pc += instruction.arg;
+					break;
+				case OpCode::INTEGRATE:
+					top[-2] = integrate(program, globals, frame, pc, top - 2);
+					top--;
+					pc += instruction.arg;
+					break;
+				case OpCode::DIFF:
+					top[-1] = differentiate(program, globals, frame, pc, top - 1, std::integral_constant<bool, math::Order<T>::value < DIFF_ORDER>());
+					pc += instruction.arg;
+					break;
+				case OpCode::ROOT:
+					top[-2] = root(program, globals, frame, pc, top - 2);
+					top--;
+					pc += instruction.arg;
+					break;
+				case OpCode::NEWTON:
+					top[-1] = newton(program, globals, frame, pc, top - 1);
+					pc += instruction.arg;
+					break;
+				case OpCode::MINIMIZE:
+					top[-2] = minimize(program, globals, frame, pc, top - 2);
+					top--;
+					pc += instruction.arg;
+					break;
+			}
+		}
+		return top[-1];
+	}
+	// The reduction at code[at] is followed by its body. range[0] and range[1] hold the
+	// bounds; range[0] doubles as the loop variable the body reads.
+	T reduce(const Program &program, T *const *globals, T *frame, size_t at, T *range) {
+		OpCode op = program.code[at].op;
+		size_t begin = at + 1, end = begin + program.code[at].arg;
+		T lo = range[0];
+		double span = std::floor(double(range[1] - lo));
+		uint64_t count = span >= 0 ? uint64_t(span) + 1 : 0;
+		if(Batch<T>::supports(program, begin, end)) {
+			int index = int(range - frame);
+			unsigned threads = concurrency(count * (end - begin));
+			std::vector<Accumulator<T>> parts(threads, Accumulator<T>(op));
+			parallel(count, threads, [&](unsigned t, uint64_t first, uint64_t last) {
+				parts[t] = Batch<T>(program, begin, end, globals, frame, index).reduce(op, lo, first, last);
+			});
+			Accumulator<T> acc(op);
+			for(auto &part : parts) {
+				if(not part.empty) acc.add(part.result());
+			}
+			return acc.result();
+		}
+		Accumulator<T> acc(op);
+		for(uint64_t k = 0; k < count; k++) {
+			range[0] = lo + T(double(k));
+			acc.add(execute(program, globals, frame, begin, end, range + 2));
+		}
+		return acc.result();
+	}
+	// Evaluates the loop body at every x, passed in range[0].
+	void sample(const Program &program, T *const *globals, T *frame, size_t begin, size_t end, T *range, const std::vector<T> &xs, std::vector<T> &ys) {
+		ys.resize(xs.size());
+		if(Batch<T>::supports(program, begin, end)) {
+			int index = int(range - frame);
+			parallel(xs.size(), concurrency(xs.size() * (end - begin)), [&](unsigned, uint64_t first, uint64_t last) {
+				Batch<T>(program, begin, end, globals, frame, index).map(xs.data() + first, ys.data() + first, last - first);
+			});
+			return;
+		}
+		for(size_t k = 0; k < xs.size(); k++) {
+			range[0] = xs[k];
+			ys[k] = execute(program, globals, frame, begin, end, range + 2);
+		}
+	}
+	// Adaptive 15-point Gauss-Kronrod quadrature. Every round evaluates all pending
+	// segments as one batch, then bisects those whose error exceeds their share of
+	// the tolerance.
+	T integrate(const Program &program, T *const *globals, T *frame, size_t at, T *range) {
+		if(math::Rigorous<T>::value) throw Uncertain("integrate has no rigorous error bound");
+		static const Wide nodes[8] = {
+			parseWide("0.991455371120812639206854697526329"), parseWide("0.949107912342758524526189684047851"),
+			parseWide("0.864864423359769072789712788640926"), parseWide("0.741531185599394439863864773280788"),
+			parseWide("0.586087235467691130294144845693013"), parseWide("0.405845151377397166906606412076961"),
+			parseWide("0.207784955007898467600689403773245"), parseWide("0.000000000000000000000000000000000")
+		};
+		static const Wide kronrod[8] = {
+			parseWide("0.022935322010529224963732008058970"), parseWide("0.063092092629978553290700663189204"),
+			parseWide("0.104790010322250183839876322541518"), parseWide("0.140653259715525918745189590510238"),
+			parseWide("0.169004726639267902826583426598550"), parseWide("0.190350578064785409913256402421014"),
+			parseWide("0.204432940075298892414161999234649"), parseWide("0.209482141084727828012999174891714")
+		};
+		static const Wide gauss[4] = {
+			parseWide("0.129484966168869693270611432679082"), parseWide("0.279705391489276667901467771423780"),
+			parseWide("0.381830050505118944950369775488975"), parseWide("0.417959183673469387755102040816327")
+		};
+		struct Segment {
+			T a, b, value, error, magnitude;
+		};
+		size_t begin = at + 1, end = begin + program.code[at].arg;
+		T lo = range[0], hi = range[1];
+		// An empty interval would make every segment's share of the error target NaN.
+		if(math::isZero(hi - lo)) return T(0);
+		std::vector<Segment> done, pending{ Segment{ lo, hi, T(0), T(0), T(0) } };
+		std::vector<T> xs, ys;
+		// INTEGRATE_TOLERANCE is for double; other types scale it with their precision.
+		T epsilon = math::Limits<T>::epsilon();
+		T tolerance = T(INTEGRATE_TOLERANCE) * math::pow(epsilon / T(DBL_EPSILON), T(2) / T(3));
+		for(int round = 0; not pending.empty(); round++) {
+			xs.clear();
+			for(auto &segment : pending) {
+				T center = (segment.a + segment.b) / T(2), half = (segment.b - segment.a) / T(2);
+				for(int j = 0; j < 7; j++) xs.push_back(center - half * T(nodes[j]));
+				xs.push_back(center);
+				for(int j = 6; j >= 0; j--) xs.push_back(center + half * T(nodes[j]));
+			}
+			sample(program, globals, frame, begin, end, range, xs, ys);
+			T value = T(0), magnitude = T(0);
+			for(auto &segment : done) {
+				value += segment.value;
+				magnitude += segment.magnitude;
+			}
+			for(size_t k = 0; k < pending.size(); k++) {
+				const T *f = &ys[15 * k];
+				T half = (pending[k].b - pending[k].a) / T(2);
+				T resultKronrod = T(kronrod[7]) * f[7], resultGauss = T(gauss[3]) * f[7], resultAbs = T(kronrod[7]) * math::fabs(f[7]);
+				for(int j = 0; j < 7; j++) {
+					T pair = f[j] + f[14 - j];
+					resultKronrod += T(kronrod[j]) * pair;
+					resultAbs += T(kronrod[j]) * (math::fabs(f[j]) + math::fabs(f[14 - j]));
+					if(j % 2 == 1) resultGauss += T(gauss[j / 2]) * pair;
+				}
+				T mean = resultKronrod / T(2), resultAsc = T(kronrod[7]) * math::fabs(f[7] - mean);
+				for(int j = 0; j < 7; j++) resultAsc += T(kronrod[j]) * (math::fabs(f[j] - mean) + math::fabs(f[14 - j] - mean));
+				T error = math::fabs((resultKronrod - resultGauss) * half);
+				resultAsc = math::fabs(resultAsc * half);
+				if(resultAsc != T(0) && error != T(0)) error = resultAsc * std::min(T(1), math::pow(T(200) * error / resultAsc, T(1.5)));
+				pending[k].value = resultKronrod * half;
+				pending[k].error = error;
+				pending[k].magnitude = math::fabs(resultAbs * half);
+				value += pending[k].value;
+				magnitude += pending[k].magnitude;
+			}
+			T target = std::max(tolerance * math::fabs(value), T(50) * epsilon * magnitude);
+			T width = math::fabs(hi - lo);
+			std::vector<Segment> next;
+			for(auto &segment : pending) {
+				bool converged = segment.error <= target * math::fabs(segment.b - segment.a) / width;
+				if(converged || INTEGRATE_ROUNDS <= round + 1 || INTEGRATE_LIMIT < next.size() + 2) {
+					done.push_back(segment);
+					continue;
+				}
+				T middle = (segment.a + segment.b) / T(2);
+				next.push_back(Segment{ segment.a, middle, T(0), T(0), T(0) });
+				next.push_back(Segment{ middle, segment.b, T(0), T(0), T(0) });
+			}
+			pending.swap(next);
+		}
+		Accumulator<T> acc(OpCode::SUM);
+		for(auto &segment : done) acc.add(segment.value);
+		return acc.result();
+	}
+	// Runs code[begin, end) on dual numbers, with the point in x, which the body reads
+	// as its variable, and the derivative seeded there and on global `seed` if any.
+	Dual<T> dual(const Program &program, T *const *globals, T *frame, size_t begin, size_t end, T *x, int seed) {
+		static thread_local Machine<Dual<T>> machine;
+		int slot = int(x - frame);
+		std::vector<Dual<T>> locals(frame, frame + slot + 1), values;
+		std::vector<Dual<T> *> table;
+		locals[slot].derivative = T(1);
+		for(size_t k = 0; k < program.globals.size(); k++) values.push_back(Dual<T>(*globals[k], T(int(k) == seed)));
+		for(auto &value : values) table.push_back(&value);
+		return machine.run(program, table.data(), locals, begin, end);
+	}
+	// Reruns the body of diff on dual numbers. When x was loaded from a global,
+	// callees see that global's derivative too.
+	T differentiate(const Program &program, T *const *globals, T *frame, size_t at, T *x, std::true_type) {
+		size_t begin = at + 1, end = begin + program.code[at].arg;
+		auto &source = program.code[at - 1];
+		return dual(program, globals, frame, begin, end, x, source.op == OpCode::LOAD ? source.arg : -1).derivative;
+	}
+	T differentiate(const Program &, T *const *, T *, size_t, T *, std::false_type) {
+		throw std::runtime_error("diff is nested too deeply");
+	}
+	// Evaluates the body at SOLVE_SAMPLES + 1 evenly spaced points of [a, b] as one batch.
+	void scan(const Program &program, T *const *globals, T *frame, size_t begin, size_t end, T *range, T a, T b, std::vector<T> &xs, std::vector<T> &ys) {
+		xs.resize(SOLVE_SAMPLES + 1);
+		for(int k = 0; k <= SOLVE_SAMPLES; k++) xs[k] = a + (b - a) * T(double(k)) / T(double(SOLVE_SAMPLES));
+		sample(program, globals, frame, begin, end, range, xs, ys);
+	}
+	// Brent's method between range[0] and range[1]. When the body has the same sign at
+	// both ends, the first sign change found by a scan of the interval brackets the root.
+	T root(const Program &program, T *const *globals, T *frame, size_t at, T *range) {
+		if(math::Rigorous<T>::value) throw Uncertain("solve has no rigorous error bound");
+		size_t begin = at + 1, end = begin + program.code[at].arg;
+		auto f = [&](T x) {
+			range[0] = x;
+			return execute(program, globals, frame, begin, end, range + 2);
+		};
+		auto brackets = [](const T &fa, const T &fb) { return (fa <= T(0) && T(0) <= fb) || (fb <= T(0) && T(0) <= fa); };
+		T a = range[0], b = range[1], fa = f(a), fb = f(b);
+		if(not brackets(fa, fb)) {
+			std::vector<T> xs, ys;
+			scan(program, globals, frame, begin, end, range, a, b, xs, ys);
+			int k = 0;
+			while(k < SOLVE_SAMPLES && not brackets(ys[k], ys[k + 1])) k++;
+			if(k == SOLVE_SAMPLES) return T(NAN);
+			a = xs[k], b = xs[k + 1], fa = ys[k], fb = ys[k + 1];
+		}
+		T epsilon = math::Limits<T>::epsilon(), c = b, fc = fb, d = b - a, e = d;
+		for(int iteration = 0; iteration < SOLVE_ITERATIONS; iteration++) {
+			if((fb < T(0)) == (fc < T(0))) {
+				c = a, fc = fa;
+				e = d = b - a;
+			}
+			if(math::fabs(fc) < math::fabs(fb)) {
+				a = b, b = c, c = a;
+				fa = fb, fb = fc, fc = fa;
+			}
+			T tolerance = T(2) * epsilon * math::fabs(b) + epsilon * epsilon, m = (c - b) / T(2);
+			if(math::fabs(m) <= tolerance || math::isZero(fb)) return b;
+			if(tolerance <= math::fabs(e) && math::fabs(fb) < math::fabs(fa)) {
+				// Secant or inverse quadratic interpolation, if it stays well inside the bracket.
+				T s = fb / fa, p, q;
+				if(a == c) {
+					p = T(2) * m * s;
+					q = T(1) - s;
+				}
+				else {
+					T r = fb / fc;
+					q = fa / fc;
+					p = s * (T(2) * m * q * (q - r) - (b - a) * (r - T(1)));
+					q = (q - T(1)) * (r - T(1)) * (s - T(1));
+				}
+				if(T(0) < p) q = -q;
+				else p = -p;
+				if(T(2) * p < std::min(T(3) * m * q - math::fabs(tolerance * q), math::fabs(e * q))) {
+					e = d;
+					d = p / q;
+				}
+				else d = e = m;
+			}
+			else d = e = m;
+			a = b, fa = fb;
+			b += tolerance < math::fabs(d) ? d : T(0) < m ? tolerance : -tolerance;
+			fb = f(b);
+		}
+		return b;
+	}
+	// The Newton step f(x) / f'(x), with f' from the body run on dual numbers, or where
+	// those would nest deeper than DIFF_ORDER, from a central difference.
+	T step(const Program &program, T *const *globals, T *frame, size_t begin, size_t end, T *x, std::true_type) {
+		Dual<T> y = dual(program, globals, frame, begin, end, x, -1);
+		return math::isZero(y.value) ? T(0) : y.value / y.derivative;
+	}
+	T step(const Program &program, T *const *globals, T *frame, size_t begin, size_t end, T *x, std::false_type) {
+		T point = x[0], h = math::sqrt(math::Limits<T>::epsilon()) * std::max(math::fabs(point), T(1));
+		x[0] = point + h;
+		T above = execute(program, globals, frame, begin, end, x + 1);
+		x[0] = point - h;
+		T below = execute(program, globals, frame, begin, end, x + 1);
+		x[0] = point;
+		T y = execute(program, globals, frame, begin, end, x + 1);
+		return math::isZero(y) ? T(0) : y * T(2) * h / (above - below);
+	}
+	// Newton's method from x. Gives nan unless the steps shrink to rounding level
+	// within SOLVE_ITERATIONS.
+	T newton(const Program &program, T *const *globals, T *frame, size_t at, T *x) {
+		if(math::Rigorous<T>::value) throw Uncertain("newton has no rigorous error bound");
+		size_t begin = at + 1, end = begin + program.code[at].arg;
+		T epsilon = math::Limits<T>::epsilon();
+		for(int iteration = 0; iteration < SOLVE_ITERATIONS; iteration++) {
+			T point = x[0], delta = step(program, globals, frame, begin, end, x, std::integral_constant<bool, math::Order<T>::value < DIFF_ORDER>());
+			x[0] = point - delta;
+			if(math::fabs(delta) <= T(4) * epsilon * math::fabs(x[0])) return x[0];
+		}
+		return T(NAN);
+	}
+	// The point of [range[0], range[1]] where the body is least: Brent's combination of
+	// golden-section search and parabolic steps, around the least point of a scan.
+	T minimize(const Program &program, T *const *globals, T *frame, size_t at, T *range) {
+		if(math::Rigorous<T>::value) throw Uncertain("minimize has no rigorous error bound");
+		size_t begin = at + 1, end = begin + program.code[at].arg;
+		auto f = [&](T x) {
+			range[0] = x;
+			return execute(program, globals, frame, begin, end, range + 2);
+		};
+		std::vector<T> xs, ys;
+		scan(program, globals, frame, begin, end, range, range[0], range[1], xs, ys);
+		int best = 0;
+		for(int k = 1; k <= SOLVE_SAMPLES; k++) {
+			if(ys[k] < ys[best] || not (ys[best] == ys[best])) best = k;
+		}
+		T a = std::min(xs[std::max(best - 1, 0)], xs[std::min(best + 1, SOLVE_SAMPLES)]);
+		T b = std::max(xs[std::max(best - 1, 0)], xs[std::min(best + 1, SOLVE_SAMPLES)]);
+		T golden = (T(3) - math::sqrt(T(5))) / T(2), relative = math::sqrt(math::Limits<T>::epsilon());
+		T x = xs[best], w = x, v = x, fx = ys[best], fw = fx, fv = fx, d = T(0), e = T(0);
+		for(int iteration = 0; iteration < SOLVE_ITERATIONS; iteration++) {
+			T middle = (a + b) / T(2), tolerance = relative * math::fabs(x) + math::Limits<T>::epsilon();
+			if(math::fabs(x - middle) <= T(2) * tolerance - (b - a) / T(2)) break;
+			bool parabolic = false;
+			if(tolerance < math::fabs(e)) {
+				T r = (x - w) * (fx - fv), q = (x - v) * (fx - fw), p = (x - v) * q - (x - w) * r;
+				q = T(2) * (q - r);
+				if(T(0) < q) p = -p;
+				else q = -q;
+				if(math::fabs(p) < math::fabs(q * e / T(2)) && q * (a - x) < p && p < q * (b - x)) {
+					e = d;
+					d = p / q;
+					parabolic = true;
+					T u = x + d;
+					if(u - a < T(2) * tolerance || b - u < T(2) * tolerance) d = x < middle ? tolerance : -tolerance;
+				}
+			}
+			if(not parabolic) {
+				e = (x < middle ? b : a) - x;
+				d = golden * e;
+			}
+			T u = x + (tolerance <= math::fabs(d) ? d : T(0) < d ? tolerance : -tolerance), fu = f(u);
+			if(fu <= fx) {
+				(u < x ? b : a) = x;
+				v = w, fv = fw;
+				w = x, fw = fx;
+				x = u, fx = fu;
+			}
+			else {
+				(u < x ? a : b) = u;
+				if(fu <= fw || w == x) {
+					v = w, fv = fw;
+					w = u, fw = fu;
+				}
+				else if(fu <= fv || v == x || v == w) v = u, fv = fu;
+			}
+		}
+		return x;
+	}
+public:
+	Machine() : stack(MAX_STACK), tables(MAX_STACK) {}
+	T run(const Program &program, T *const *globals) {
+		if(size_t(program.depth) > stack.size()) throw std::runtime_error("Stack overflow");
+		tableTop = 0;
+		calls = 0;
+		return execute(program, globals, stack.data(), 0, program.code.size(), stack.data());
+	}
+	// Runs code[begin, end) with the given values as the bottom of the stack.
+	T run(const Program &program, T *const *globals, const std::vector<T> &frame, size_t begin, size_t end) {
+		if(size_t(program.depth) > stack.size()) throw std::runtime_error("Stack overflow");
+		tableTop = 0;
+		calls = 0;
+		std::copy(frame.begin(), frame.end(), stack.begin());
+		return execute(program, globals, stack.data(), begin, end, stack.data() + frame.size());
+	}
+};
+
+inline bool isHidden(const std::string &name) {
+	return name[0] == '#';
+}
+
+template<class T>
+void requireDefined(const Program &program, const Variables<T> &variables) {
+	for(size_t k = 0; k < program.globals.size(); k++) {
+		auto &name = program.globals[k];
+		if(not program.assigned[k] && not isHidden(name) && variables.find(name) == variables.end() && variables.arrays.find(name) == variables.arrays.end()) {
+			throw std::runtime_error("Undefined variable: " + name.name());
+		}
+	}
+}
+
+// Variables the program and its stages read or write, without the hidden stage results.
+inline std::vector<Symbol> references(const Program &program) {
+	std::vector<Symbol> names;
+	auto add = [&](Symbol name) {
+		if(not isHidden(name) && std::find(names.begin(), names.end(), name) == names.end()) names.push_back(name);
+	};
+	for(auto &name : program.globals) add(name);
+	for(auto &stage : program.stages) {
+		for(auto &argument : stage.arguments) {
+			for(auto &name : references(*argument)) add(name);
+		}
+	}
+	return names;
+}
+
+// Names the program or its stages assign.
+inline void assignments(const Program &program, std::vector<Symbol> &names) {
+	for(size_t k = 0; k < program.globals.size(); k++) {
+		if(program.assigned[k]) names.push_back(program.globals[k]);
+	}
+	for(auto &stage : program.stages) {
+		for(auto &argument : stage.arguments) assignments(*argument, names);
+	}
+}
+
+// A variable the program or its stages use that is neither defined nor assigned
+// anywhere in them, or "" if there is none. A caller can report it up front rather
+// than through the exception evaluate would raise.
+template<class T>
+std::string undefined(const Program &program, const Variables<T> &variables) {
+	std::vector<Symbol> assigned;
+	assignments(program, assigned);
+	for(auto &name : references(program)) {
+		if(variables.count(name) || variables.arrays.count(name)) continue;
+		if(std::find(assigned.begin(), assigned.end(), name) == assigned.end()) return name;
+	}
+	return "";
+}
+
+// Whether the program draws random numbers, itself or in the functions it calls.
+inline bool draws(const Program &program) {
+	for(auto &instruction : program.code) {
+		if(instruction.op == OpCode::RAND || instruction.op == OpCode::RANDN) return true;
+	}
+	for(auto &site : program.calls) {
+		if(site.function && draws(site.function->body)) return true;
+	}
+	return false;
+}
+
+// Whether running the program can reach a memo table, which threads must not share.
+inline bool memoized(const Program &program) {
+	for(auto &site : program.calls) {
+		auto &callee = site.function ? site.function->body : program;
+		if(callee.memo && callee.memo->enabled) return true;
+		if(site.function && memoized(callee)) return true;
+	}
+	return false;
+}
+
+// c += a b, or c -= a b, for an n x m matrix a and an m x p matrix b, each with its
+// own row stride. Threads take bands of rows of c; each runs over b a MATRIX_BLOCK
+// square tile at a time, so the tile stays in cache for all the rows of the band.
+// The innermost loop walks along rows of b and c, so that it vectorizes, and updates
+// four rows of c with each element of b it loads.
+template<class T>
+void multiply(const T *a, size_t lda, const T *b, size_t ldb, T *c, size_t ldc, uint64_t n, uint64_t m, uint64_t p, bool subtract = false) {
+	parallel(n, concurrency(n * m * p), [&](unsigned, uint64_t first, uint64_t last) {
+		T sign = subtract ? T(-1) : T(1);
+		for(uint64_t k0 = 0; k0 < m; k0 += MATRIX_BLOCK) {
+			uint64_t k1 = std::min<uint64_t>(m, k0 + MATRIX_BLOCK);
+			for(uint64_t j0 = 0; j0 < p; j0 += MATRIX_BLOCK) {
+				uint64_t j1 = std::min<uint64_t>(p, j0 + MATRIX_BLOCK);
+				uint64_t i = first;
+				for(; i + 4 <= last; i += 4) {
+					T *c0 = c + i * ldc, *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;
+					for(uint64_t k = k0; k < k1; k++) {
+						const T *ak = a + i * lda + k, *bk = b + k * ldb;
+						T f0 = sign * ak[0], f1 = sign * ak[lda], f2 = sign * ak[2 * lda], f3 = sign * ak[3 * lda];
+						for(uint64_t j = j0; j < j1; j++) {
+							T x = bk[j];
+							c0[j] += f0 * x;
+							c1[j] += f1 * x;
+							c2[j] += f2 * x;
+							c3[j] += f3 * x;
+						}
+					}
+				}
+				for(; i < last; i++) {
+					T *ci = c + i * ldc;
+					for(uint64_t k = k0; k < k1; k++) {
+						T f = sign * a[i * lda + k];
+						const T *bk = b + k * ldb;
+						for(uint64_t j = j0; j < j1; j++) ci[j] += f * bk[j];
+					}
+				}
+			}
+		}
+	});
+}
+
+// In-place LU decomposition of an n x n matrix with partial pivoting, blocked so that
+// most of the work is the trailing update done by multiply. Afterwards a holds U and,
+// below the diagonal, the unit lower triangle L; row k was swapped with pivots[k].
+// Returns the sign of the permutation, or 0 when the matrix is singular.
+template<class T>
+int decompose(T *a, uint64_t n, std::vector<uint64_t> &pivots) {
+	int sign = 1;
+	pivots.resize(n);
+	for(uint64_t k0 = 0; k0 < n; k0 += MATRIX_BLOCK) {
+		uint64_t k1 = std::min<uint64_t>(n, k0 + MATRIX_BLOCK);
+		for(uint64_t k = k0; k < k1; k++) {
+			uint64_t best = k;
+			for(uint64_t r = k + 1; r < n; r++) {
+				if(math::fabs(a[best * n + k]) < math::fabs(a[r * n + k])) best = r;
+			}
+			pivots[k] = best;
+			if(best != k) {
+				std::swap_ranges(a + k * n, a + k * n + n, a + best * n);
+				sign = -sign;
+			}
+			T pivot = a[k * n + k];
+			if(math::isZero(pivot)) return 0;
+			for(uint64_t r = k + 1; r < n; r++) {
+				T f = a[r * n + k] = a[r * n + k] / pivot;
+				for(uint64_t j = k + 1; j < k1; j++) a[r * n + j] += -f * a[k * n + j];
+			}
+		}
+		// The rows of U right of the panel, then the rest of the matrix.
+		for(uint64_t k = k0; k < k1; k++) {
+			for(uint64_t r = k + 1; r < k1; r++) {
+				T f = -a[r * n + k];
+				for(uint64_t j = k1; j < n; j++) a[r * n + j] += f * a[k * n + j];
+			}
+		}
+		if(k1 < n) multiply(a + k1 * n + k0, n, a + k0 * n + k1, n, a + k1 * n + k1, n, n - k1, k1 - k0, n - k1, true);
+	}
+	return sign;
+}
+
+// Overwrites the n x m matrix b with the solution x of A x = b, given A decomposed.
+// Threads take bands of columns of b, and solve for MATRIX_BLOCK columns at a time.
+template<class T>
+void substitute(const T *lu, const std::vector<uint64_t> &pivots, uint64_t n, T *b, uint64_t m) {
+	for(uint64_t k = 0; k < n; k++) {
+		if(pivots[k] != k) std::swap_ranges(b + k * m, b + k * m + m, b + pivots[k] * m);
+	}
+	parallel(m, concurrency(n * n * m), [&](unsigned, uint64_t first, uint64_t last) {
+		for(uint64_t j0 = first; j0 < last; j0 += MATRIX_BLOCK) {
+			uint64_t j1 = std::min<uint64_t>(last, j0 + MATRIX_BLOCK);
+			for(uint64_t k = 0; k < n; k++) {
+				for(uint64_t r = k + 1; r < n; r++) {
+					T f = -lu[r * n + k];
+					for(uint64_t j = j0; j < j1; j++) b[r * m + j] += f * b[k * m + j];
+				}
+			}
+			for(uint64_t k = n; k-- > 0;) {
+				T pivot = lu[k * n + k];
+				for(uint64_t j = j0; j < j1; j++) b[k * m + j] = b[k * m + j] / pivot;
+				for(uint64_t r = 0; r < k; r++) {
+					T f = -lu[r * n + k];
+					for(uint64_t j = j0; j < j1; j++) b[r * m + j] += f * b[k * m + j];
+				}
+			}
+		}
+	});
+}
+
+// Result of a statement: an array when any of its inputs was one, otherwise a scalar.
+// An array is a shared buffer, or a sequence that is only generated where it is read.
+template<class T>
+struct Value {
+	bool array = false;
+	T scalar = T(0);
+	Column<T> column;
+	std::shared_ptr<const Array<T>> buffer;
+	std::shared_ptr<const Array<T>> materialize() const {
+		if(buffer) return buffer;
+		auto elements = std::make_shared<Array<T>>(column.size);
+		for(uint64_t k = 0; k < column.size; k++) (*elements)[k] = column.at(k);
+		return elements;
+	}
+};
+
+template<class T>
+Value<T> held(std::shared_ptr<const Array<T>> elements) {
+	Value<T> result;
+	result.array = true;
+	result.column.data = const_cast<T *>(elements->data());
+	result.column.size = elements->size();
+	result.buffer = elements;
+	return result;
+}
+
+// Arrays with more than PRINT_LIMIT elements show only their first and last few
+// elements, or for matrices their first and last few rows and columns.
+template<class T>
+void print(std::ostream &stream, const T *elements, size_t size, bool shorten) {
+	stream << '[';
+	for(size_t k = 0; k < size; k++) {
+		if(k) stream << ", ";
+		if(shorten && 6 < size && k == 3) {
+			stream << "..., ";
+			k = size - 3;
+		}
+		print(stream, elements[k]);
+	}
+	stream << ']';
+}
+
+template<class T>
+void print(std::ostream &stream, const Array<T> &array) {
+	bool shorten = PRINT_LIMIT < array.size();
+	if(not array.width) return print(stream, array.data(), array.size(), shorten);
+	size_t rows = array.size() / array.width;
+	stream << '[';
+	for(size_t k = 0; k < rows; k++) {
+		if(k) stream << ", ";
+		if(shorten && 6 < rows && k == 3) {
+			stream << "..., ";
+			k = rows - 3;
+		}
+		print(stream, array.data() + k * array.width, array.width, shorten);
+	}
+	stream << ']';
+}
+
+// An array argument of a matrix operation as a rows x columns matrix. A plain array is a column.
+template<class T>
+std::shared_ptr<const Array<T>> matrix(const Value<T> &value, Stage::Kind kind, uint64_t &rows, uint64_t &columns) {
+	if(not value.array) throw std::runtime_error(stageName(kind) + " expects arrays");
+	auto elements = value.materialize();
+	columns = elements->width ? elements->width : 1;
+	rows = elements->size() / columns;
+	return elements;
+}
+
+// matmul treats a plain array on its left as a row, so that two plain arrays give their
+// dot product; solve and inv fail on singular matrices, for which det is 0.
+template<class T>
+Value<T> linear(Stage::Kind kind, const std::vector<Value<T>> &arguments) {
+	uint64_t n, m, p = 0, q = 0;
+	auto a = matrix(arguments[0], kind, n, m);
+	std::shared_ptr<const Array<T>> b;
+	if(arguments.size() == 2) b = matrix(arguments[1], kind, p, q);
+	auto shape = [](uint64_t rows, uint64_t columns) { return std::to_string(rows) + "x" + std::to_string(columns); };
+	auto result = std::make_shared<Array<T>>();
+	if(kind == Stage::TRANSPOSE) {
+		result->resize(n * m);
+		result->width = n;
+		for(uint64_t i0 = 0; i0 < n; i0 += MATRIX_BLOCK) {
+			for(uint64_t j0 = 0; j0 < m; j0 += MATRIX_BLOCK) {
+				for(uint64_t i = i0; i < std::min<uint64_t>(n, i0 + MATRIX_BLOCK); i++) {
+					for(uint64_t j = j0; j < std::min<uint64_t>(m, j0 + MATRIX_BLOCK); j++) (*result)[j * n + i] = (*a)[i * m + j];
+				}
+			}
+		}
+		return held<T>(result);
+	}
+	if(kind == Stage::MATMUL) {
+		if(not a->width) std::swap(n, m);
+		if(m != p) throw std::runtime_error("Matrix shapes do not match: " + shape(n, m) + " and " + shape(p, q));
+		result->assign(n * q, T(0));
+		multiply(a->data(), m, b->data(), q, result->data(), q, n, m, q);
+		if(not a->width && not b->width) {
+			Value<T> dot;
+			dot.scalar = (*result)[0];
+			return dot;
+		}
+		if(a->width && b->width) result->width = q;
+		return held<T>(result);
+	}
+	if(n != m) throw std::runtime_error(stageName(kind) + " expects a square matrix, not " + shape(n, m));
+	Array<T> lu(a->begin(), a->end());
+	std::vector<uint64_t> pivots;
+	int sign = decompose(lu.data(), n, pivots);
+	if(kind == Stage::DET) {
+		Value<T> det;
+		det.scalar = T(double(sign));
+		for(uint64_t k = 0; sign && k < n; k++) det.scalar *= lu[k * n + k];
+		return det;
+	}
+	if(not sign) throw std::runtime_error("Singular matrix");
+	if(kind == Stage::INV) {
+		result->assign(n * n, T(0));
+		result->width = n;
+		for(uint64_t k = 0; k < n; k++) (*result)[k * n + k] = T(1);
+		substitute(lu.data(), pivots, n, result->data(), n);
+		return held<T>(result);
+	}
+	if(p != n) throw std::runtime_error("Matrix shapes do not match: " + shape(n, m) + " and " + shape(p, q));
+	result->assign(b->begin(), b->end());
+	result->width = b->width;
+	substitute(lu.data(), pivots, n, result->data(), q);
+	return held<T>(result);
+}
+
+template<class T>
+void store(Variables<T> &variables, Symbol name, const T &value) {
+	variables.arrays.erase(name);
+	variables[name] = value;
+}
+
+template<class T>
+void store(Variables<T> &variables, Symbol name, const Value<T> &value) {
+	if(not value.array) return store(variables, name, value.scalar);
+	variables.erase(name);
+	variables.arrays[name] = value.materialize();
+}
+
+// Without a reduction, i.e. with CONST, an array result is kept element by element.
+template<class T>
+Value<T> evaluate(const Program &program, Variables<T> &variables, OpCode reduction = OpCode::CONST);
+
+// Element count given by an argument of linspace or range.
+template<class T>
+uint64_t length(const T &value) {
+	double n = std::floor(double(value));
+	if(not (0 <= n && n <= ARRAY_LIMIT)) throw std::runtime_error("Invalid array length");
+	return uint64_t(n);
+}
+
+template<class T>
+Value<T> sequence(T start, T step, T last, uint64_t size) {
+	Value<T> result;
+	result.array = true;
+	result.column.generated = true;
+	result.column.start = start;
+	result.column.step = step;
+	result.column.last = last;
+	result.column.size = size;
+	return result;
+}
+
+// mc(expr, n): the mean of n runs of expr, which draws fresh random numbers on every
+// run, and the standard error of that mean, as the array [mean, error].
+template<class T>
+Value<T> simulate(const Program &program, uint64_t n, Variables<T> &variables) {
+	static thread_local Machine<T> machine;
+	requireDefined(program, variables);
+	std::vector<T *> globals;
+	for(size_t k = 0; k < program.globals.size(); k++) {
+		if(program.assigned[k]) throw std::runtime_error("mc cannot assign variables");
+		if(isHidden(program.globals[k]) || variables.arrays.count(program.globals[k])) throw std::runtime_error("mc expects a scalar expression");
+		globals.push_back(&variables.find(program.globals[k])->second);
+	}
+	bool batch = Batch<T>::supports(program, 0, program.code.size());
+	unsigned threads = not batch && memoized(program) ? 1 : concurrency(program.work(n));
+	std::vector<Moments<T>> parts(threads);
+	std::vector<std::exception_ptr> errors(threads);
+	parallel(n, threads, [&](unsigned t, uint64_t first, uint64_t last) {
+		if(batch) {
+			Batch<T>(program, 0, program.code.size(), globals.data(), nullptr, -2).elements(nullptr, first, last, nullptr, &parts[t]);
+			return;
+		}
+		try {
+			for(uint64_t e = first; e < last; e++) parts[t].add(machine.run(program, globals.data()));
+		}
+		catch(...) {
+			errors[t] = std::current_exception();
+		}
+	});
+	for(auto &error : errors) {
+		if(error) std::rethrow_exception(error);
+	}
+	Moments<T> total;
+	for(auto &part : parts) total.merge(part);
+	auto result = std::make_shared<Array<T>>();
+	result->push_back(total.mean);
+	result->push_back(math::sqrt(total.squares / T(double(total.count) - 1.0) / T(double(total.count))));
+	return held<T>(result);
+}
+
+// grad(expr, x, y, ...): the partial derivatives of expr by each variable at its
+// current value, as an array. Each is one run of expr on dual numbers seeded at that
+// variable; the arguments after expr compile to loads of the variables.
+template<class T>
+Value<T> gradient(const Stage &stage, Variables<T> &variables) {
+	static thread_local Machine<Dual<T>> machine;
+	auto &program = *stage.arguments[0];
+	requireDefined(program, variables);
+	std::vector<Dual<T>> values;
+	for(size_t k = 0; k < program.globals.size(); k++) {
+		if(program.assigned[k]) throw std::runtime_error("grad cannot assign variables");
+		if(isHidden(program.globals[k]) || variables.arrays.count(program.globals[k])) throw std::runtime_error("grad expects a scalar expression");
+		values.push_back(Dual<T>(variables.find(program.globals[k])->second));
+	}
+	std::vector<Dual<T> *> table;
+	for(auto &value : values) table.push_back(&value);
+	auto result = std::make_shared<Array<T>>();
+	for(size_t j = 1; j < stage.arguments.size(); j++) {
+		Symbol name = stage.arguments[j]->globals[0];
+		if(variables.arrays.count(name)) throw std::runtime_error("grad expects scalar variables");
+		if(not variables.count(name)) throw std::runtime_error("Undefined variable: " + name.name());
+		auto at = std::find(program.globals.begin(), program.globals.end(), name);
+		if(at == program.globals.end()) {
+			result->push_back(T(0));
+			continue;
+		}
+		auto &seed = values[at - program.globals.begin()];
+		seed.derivative = T(1);
+		result->push_back(machine.run(program, table.data()).derivative);
+		seed.derivative = T(0);
+	}
+	return held<T>(result);
+}
+
+// Reductions run their argument with the reduction in place of its result array.
+template<class T>
+Value<T> build(const Stage &stage, Variables<T> &variables) {
+	if(stage.kind == Stage::REDUCE) return evaluate(*stage.arguments[0], variables, stage.op);
+	if(stage.kind == Stage::MC) {
+		Value<T> count = evaluate(*stage.arguments[1], variables);
+		if(count.array) throw std::runtime_error("mc expects a scalar count");
+		return simulate(*stage.arguments[0], length(count.scalar), variables);
+	}
+	if(stage.kind == Stage::GRAD) return gradient(stage, variables);
+	std::vector<Value<T>> arguments;
+	for(auto &argument : stage.arguments) arguments.push_back(evaluate(*argument, variables));
+	if(stage.kind == Stage::LIST || stage.kind == Stage::MATRIX) {
+		auto elements = std::make_shared<Array<T>>();
+		for(auto &argument : arguments) {
+			size_t before = elements->size();
+			if(argument.array) {
+				auto part = argument.materialize();
+				elements->insert(elements->end(), part->begin(), part->end());
+			}
+			else elements->push_back(argument.scalar);
+			if(ARRAY_LIMIT < elements->size()) throw std::runtime_error("Invalid array length");
+			if(stage.kind != Stage::MATRIX) continue;
+			if(before && elements->size() - before != elements->width) throw std::runtime_error("Matrix rows differ in length");
+			elements->width = elements->size() - before;
+		}
+		return held<T>(elements);
+	}
+	if(Stage::MATMUL <= stage.kind) return linear(stage.kind, arguments);
+	for(auto &argument : arguments) {
+		if(argument.array) throw std::runtime_error(stageName(stage.kind) + " expects scalar arguments");
+	}
+	if(stage.kind == Stage::LINSPACE) {
+		T a = arguments[0].scalar, b = arguments[1].scalar;
+		uint64_t n = length(arguments[2].scalar);
+		return sequence(a, n > 1 ? (b - a) / T(double(n - 1)) : T(0), n > 1 ? b : a, n);
+	}
+	// range(n) counts from 0 and range(a, b) steps by 1; b itself is excluded.
+	T a = arguments.size() == 1 ? T(0) : arguments[0].scalar;
+	T b = arguments.size() == 1 ? arguments[0].scalar : arguments[1].scalar;
+	T step = arguments.size() == 3 ? arguments[2].scalar : T(1);
+	double count = std::ceil(double((b - a) / step));
+	uint64_t n = count > 0 ? length(T(count)) : 0;
+	return sequence(a, step, a + T(double(n ? n - 1 : 0)) * step, n);
+}
+
+// Runs a program without stages once per element. Globals with an active column read
+// element k of it, and must have one if they are assigned; the others are the scalars
+// in globals. Straight-line code runs BATCH_SIZE elements at a time, and threads, at
+// most limit of them unless it is 0, take bands of elements. Programs that reach a
+// memo table run on one thread.
+template<class T>
+void sweep(const Program &program, const Column<T> *columns, T *const *globals, uint64_t n, T *results, unsigned limit = 0) {
+	static thread_local Machine<T> machine;
+	auto threads = [&](uint64_t work) {
+		unsigned count = concurrency(work);
+		return limit ? std::min(count, limit) : count;
+	};
+	if(Batch<T>::supports(program, 0, program.code.size(), true)) {
+		parallel(n, threads(n * program.code.size()), [&](unsigned, uint64_t first, uint64_t last) {
+			Batch<T>(program, 0, program.code.size(), globals, nullptr, -2).elements(columns, first, last, results, static_cast<Accumulator<T> *>(nullptr));
+		});
+		return;
+	}
+	size_t count = program.globals.size();
+	std::vector<std::exception_ptr> errors(memoized(program) ? 1 : threads(program.work(n)));
+	parallel(n, unsigned(errors.size()), [&](unsigned t, uint64_t first, uint64_t last) {
+		try {
+			std::vector<T *> table(globals, globals + count);
+			std::vector<T> generated(count);
+			for(uint64_t e = first; e < last; e++) {
+				for(size_t k = 0; k < count; k++) {
+					if(columns[k].data) table[k] = columns[k].data + e;
+					else if(columns[k].generated) table[k] = &(generated[k] = columns[k].at(e));
+				}
+				results[e] = machine.run(program, table.data());
+			}
+		}
+		catch(...) {
+			errors[t] = std::current_exception();
+		}
+	});
+	for(auto &error : errors) {
+		if(error) std::rethrow_exception(error);
+	}
+}
+
+// Runs the stages, then the program. When it reads an array, the whole program runs
+// once per element with the arrays' elements in place of the arrays, BATCH_SIZE
+// elements at a time where it is straight-line code, so intermediate values only
+// ever take one block. Every variable it assigns becomes an array.
+template<class T>
+Value<T> evaluate(const Program &program, Variables<T> &variables, OpCode reduction) {
+	static thread_local Machine<T> machine;
+	requireDefined(program, variables);
+	std::vector<Value<T>> stages;
+	for(auto &stage : program.stages) stages.push_back(build(stage, variables));
+	size_t count = program.globals.size();
+	std::vector<int> loads(count), stores(count);
+	for(auto &instruction : program.code) {
+		if(instruction.op == OpCode::LOAD) loads[instruction.arg]++;
+		if(instruction.op == OpCode::STORE) stores[instruction.arg]++;
+	}
+	// Keeps the variables' buffers alive while the program replaces them.
+	std::vector<std::shared_ptr<const Array<T>>> inputs(count);
+	std::vector<Column<T>> columns(count);
+	std::vector<bool> arrays(count);
+	bool elementwise = false;
+	uint64_t size = 0, width = 0;
+	for(size_t k = 0; k < count; k++) {
+		auto &name = program.globals[k];
+		if(isHidden(name)) {
+			auto &stage = stages[std::stoul(name.name().substr(1))];
+			if(stage.array) columns[k] = stage.column;
+			inputs[k] = stage.buffer;
+			arrays[k] = stage.array;
+		}
+		else if(loads[k]) {
+			auto it = variables.arrays.find(name);
+			if(it != variables.arrays.end()) {
+				inputs[k] = it->second;
+				columns[k].data = const_cast<T *>(inputs[k]->data());
+				columns[k].size = inputs[k]->size();
+				arrays[k] = true;
+			}
+		}
+		if(not arrays[k]) continue;
+		if(elementwise && columns[k].size != size) {
+			throw std::runtime_error("Array lengths differ: " + std::to_string(size) + " and " + std::to_string(columns[k].size));
+		}
+		elementwise = true;
+		size = columns[k].size;
+		// Matrices keep their shape; a plain array of the same length takes it on.
+		if(not inputs[k] || not inputs[k]->width) continue;
+		if(width && inputs[k]->width != width) throw std::runtime_error("Matrix shapes differ");
+		width = inputs[k]->width;
+	}
+	std::vector<T *> globals;
+	std::vector<Symbol> created;
+	Value<T> result;
+	if(not elementwise) {
+		for(size_t k = 0; k < count; k++) {
+			auto &name = program.globals[k];
+			if(isHidden(name)) {
+				globals.push_back(&stages[std::stoul(name.name().substr(1))].scalar);
+				continue;
+			}
+			auto entry = variables.emplace(name, T(NAN));
+			if(entry.second) created.push_back(name);
+			globals.push_back(&entry.first->second);
+		}
+		try {
+			result.scalar = machine.run(program, globals.data());
+		}
+		catch(...) {
+			for(auto &name : created) variables.erase(name);
+			throw;
+		}
+		// Array variables the line turned into scalars are only dropped once it succeeds.
+		for(size_t k = 0; k < count; k++) {
+			if(program.assigned[k]) variables.arrays.erase(program.globals[k]);
+		}
+		return result;
+	}
+	// Without branches or loops every store runs for every element. Otherwise some
+	// elements may skip a store and must keep the variable's old value.
+	bool straight = std::none_of(program.code.begin(), program.code.end(), [](const Instruction &instruction) {
+		return instruction.op == OpCode::JUMP || instruction.op == OpCode::JUMPZ || isLoop(instruction.op);
+	});
+	// In a = b = x * 2, which ends STORE b, STORE a, STORE Ans, a and Ans share b's buffer.
+	std::vector<int> alias(count, -1);
+	for(size_t pc = 1; straight && pc < program.code.size(); pc++) {
+		auto &previous = program.code[pc - 1], &instruction = program.code[pc];
+		if(instruction.op != OpCode::STORE || previous.op != OpCode::STORE) continue;
+		if(stores[instruction.arg] == 1 && not loads[instruction.arg] && stores[previous.arg] == 1) alias[instruction.arg] = previous.arg;
+	}
+	auto root = [&](int k) {
+		while(alias[k] >= 0) k = alias[k];
+		return k;
+	};
+	// Assigned variables that are read, or may not be stored to, start as their old
+	// value spread over the elements.
+	std::vector<std::shared_ptr<Array<T>>> outputs(count);
+	for(size_t k = 0; k < count; k++) {
+		auto &name = program.globals[k];
+		if(program.assigned[k] && alias[k] < 0) {
+			outputs[k] = std::make_shared<Array<T>>(size);
+			outputs[k]->width = width;
+			auto scalar = variables.find(name);
+			if(straight && not loads[k]);
+			else if(inputs[k] && inputs[k]->size() == size) std::copy(inputs[k]->begin(), inputs[k]->end(), outputs[k]->begin());
+			else std::fill(outputs[k]->begin(), outputs[k]->end(), scalar != variables.end() ? scalar->second : T(NAN));
+			columns[k] = Column<T>();
+			columns[k].data = outputs[k]->data();
+			columns[k].size = size;
+		}
+		if(isHidden(name)) globals.push_back(&stages[std::stoul(name.name().substr(1))].scalar);
+		else if(arrays[k] || program.assigned[k]) globals.push_back(nullptr);
+		else globals.push_back(&variables.find(name)->second);
+	}
+	// A program that ends with a store already leaves its result in that variable.
+	auto &end = program.code.back();
+	std::shared_ptr<Array<T>> results;
+	if(end.op == OpCode::STORE) results = outputs[root(end.arg)];
+	else if(reduction == OpCode::CONST) {
+		results = std::make_shared<Array<T>>(size);
+		results->width = width;
+	}
+	T *out = end.op == OpCode::STORE || not results ? nullptr : results->data();
+	Accumulator<T> acc(reduction);
+	if(Batch<T>::supports(program, 0, program.code.size(), true)) {
+		unsigned threads = concurrency(size * program.code.size());
+		std::vector<Accumulator<T>> parts(threads, Accumulator<T>(reduction));
+		parallel(size, threads, [&](unsigned t, uint64_t first, uint64_t last) {
+			Batch<T>(program, 0, program.code.size(), globals.data(), nullptr, -2).elements(columns.data(), first, last, out, reduction == OpCode::CONST ? nullptr : &parts[t]);
+		});
+		for(auto &part : parts) {
+			if(not part.empty) acc.add(part.result());
+		}
+	}
+	else {
+		// Elements are independent, so threads take bands of them, e.g. to run many
+		// solves at once.
+		unsigned threads = memoized(program) ? 1 : concurrency(program.work(size));
+		std::vector<Accumulator<T>> parts(threads, Accumulator<T>(reduction));
+		std::vector<std::exception_ptr> errors(threads);
+		parallel(size, threads, [&](unsigned t, uint64_t first, uint64_t last) {
+			try {
+				std::vector<T *> table(globals);
+				std::vector<T> generated(count);
+				for(uint64_t e = first; e < last; e++) {
+					for(size_t k = 0; k < count; k++) {
+						if(columns[k].data) table[k] = columns[k].data + e;
+						else if(columns[k].generated) table[k] = &(generated[k] = columns[k].at(e));
+						else if(program.assigned[k]) table[k] = &generated[k];
+					}
+					T value = machine.run(program, table.data());
+					if(out) out[e] = value;
+					else if(reduction != OpCode::CONST) parts[t].add(value);
+				}
+			}
+			catch(...) {
+				errors[t] = std::current_exception();
+			}
+		});
+		for(auto &error : errors) {
+			if(error) std::rethrow_exception(error);
+		}
+		for(auto &part : parts) {
+			if(not part.empty) acc.add(part.result());
+		}
+	}
+	for(size_t k = 0; k < count; k++) {
+		if(not program.assigned[k]) continue;
+		variables.erase(program.globals[k]);
+		variables.arrays[program.globals[k]] = outputs[root(int(k))];
+	}
+	if(reduction != OpCode::CONST) {
+		result.scalar = acc.result();
+		return result;
+	}
+	return held<T>(results);
+}
+
+struct Run;
+
+// A value in big-float mode. The enclosure is a rigorous double interval from the
+// fast evaluation; the big-float value is only computed when the enclosure is too
+// wide to print, by rerunning the program that produced it on its saved inputs.
+struct Lazy {
+	Interval enclosure;
+	std::shared_ptr<Run> run;
+	size_t index;
+	Lazy(double x = 0.0);
+	Lazy(const Interval &e, std::shared_ptr<Run> r, size_t i) : enclosure(e), run(std::move(r)), index(i) {}
+};
+
+struct Run {
+	std::shared_ptr<const Program> program;
+	std::vector<Lazy> inputs;
+	std::vector<BigFloat> results; // every global after the run, then the returned value
+	int depth = 0;
+	bool done = false;
+};
+
+inline Lazy::Lazy(double x) : enclosure(x), run(std::make_shared<Run>()), index(0) {
+	run->results.push_back(BigFloat(x));
+	run->done = true;
+}
+
+inline BigFloat force(const Lazy &x) {
+	static thread_local Machine<BigFloat> machine;
+	Run &run = *x.run;
+	if(not run.done) {
+		run.results.reserve(run.inputs.size() + 1);
+		for(auto &input : run.inputs) run.results.push_back(force(input));
+		std::vector<BigFloat *> globals;
+		for(auto &value : run.results) globals.push_back(&value);
+		BigFloat value = machine.run(*run.program, globals.data());
+		run.results.push_back(value);
+		run.done = true;
+		run.program.reset();
+		run.inputs.clear();
+	}
+	return run.results[x.index];
+}
+
+// Runs the program on double intervals and defers the big-float run. When the
+// intervals cannot decide a branch it falls back to big-float at once. Chains of
+// deferred runs are cut at LAZY_DEPTH so forcing never recurses too deep. Literals
+// that are not exactly doubles enter as intervals an ulp wide, so any digit that
+// depends on the rest of their text is printed from the big-float rerun.
+inline Lazy evaluate(const Program &program, Variables<Lazy> &variables) {
+	static thread_local Machine<Interval> machine;
+	if(not program.stages.empty()) throw std::runtime_error("Arrays are not supported in big precision");
+	// A deferred big-float rerun would draw different numbers.
+	if(draws(program)) throw std::runtime_error("Random numbers are not supported in big precision");
+	requireDefined(program, variables);
+	auto run = std::make_shared<Run>();
+	run->program = std::make_shared<const Program>(program);
+	std::vector<Interval> values;
+	for(auto &name : program.globals) {
+		auto it = variables.find(name);
+		Lazy input = it == variables.end() ? Lazy(NAN) : it->second;
+		run->depth = std::max(run->depth, input.run->depth + 1);
+		run->inputs.push_back(input);
+		values.push_back(input.enclosure);
+	}
+	std::vector<Interval *> globals;
+	for(auto &value : values) globals.push_back(&value);
+	size_t index = program.globals.size();
+	Interval result;
+	try {
+		result = machine.run(program, globals.data());
+		if(LAZY_DEPTH < run->depth) force(Lazy(result, run, index));
+	}
+	catch(const Uncertain &) {
+		result = math::enclose(force(Lazy(result, run, index)));
+		for(size_t k = 0; k < values.size(); k++) values[k] = math::enclose(run->results[k]);
+	}
+	for(size_t k = 0; k < program.globals.size(); k++) {
+		if(program.assigned[k]) variables[program.globals[k]] = Lazy(values[k], run, k);
+	}
+	return Lazy(result, run, index);
+}
+
+// Prints from the enclosure when both ends agree to the requested digits.
+inline void print(std::ostream &stream, const Lazy &value) {
+	int digits = int(stream.precision());
+	char lo[128], hi[128];
+	snprintf(lo, sizeof lo, "%.*g", digits, value.enclosure.lo);
+	snprintf(hi, sizeof hi, "%.*g", digits, value.enclosure.hi);
+	if(std::strcmp(lo, hi) == 0) stream << lo;
+	else print(stream, force(value));
+}
+
+struct ASTNode {
+	size_t position = std::string::npos; // offset in the source
+	virtual ~ASTNode() = default;
+	virtual void compile(Compiler &compiler) = 0;
+};
+
+inline void Compiler::stage(Stage::Kind kind, OpCode op, const std::vector<ASTNode *> &arguments, size_t position) {
+	if(not self.name().empty() || not scope.empty()) return fail("Arrays cannot be built inside functions or loops", position);
+	Stage stage{ kind, op, {} };
+	for(auto argument : arguments) {
+		auto part = std::make_shared<Program>();
+		Compiler compiler(*part, functions);
+		argument->compile(compiler);
+		if(compiler.failure) return fail(compiler.failure.message, compiler.failure.position);
+		stage.arguments.push_back(part);
+	}
+	program.stages.push_back(std::move(stage));
+	load(Symbol("#" + std::to_string(program.stages.size() - 1)));
+}
+
+// [a, b, ...]. Array elements are spliced in, so [x, 4] appends 4 to the array x,
+// while [[1, 2], [3, 4]], written with brackets inside the brackets, is a matrix.
+struct ArrayNode : public ASTNode {
+	std::vector<ASTNode *> elements;
+	ArrayNode(std::vector<ASTNode *> e) : elements(std::move(e)) {}
+	void compile(Compiler &compiler) override {
+		bool rows = not elements.empty();
+		for(auto element : elements) {
+			if(not dynamic_cast<ArrayNode *>(element)) rows = false;
+		}
+		compiler.stage(rows ? Stage::MATRIX : Stage::LIST, OpCode::CONST, elements, position);
+	}
+};
+
+struct NumberNode : public ASTNode {
+	std::string text;
+	double value, tail;
+	bool exact;
+	NumberNode(const std::string &t) : text(t) {
+		if(text.back() == 'i') {
+			value = NAN;
+			tail = 0.0;
+			exact = false;
+			return;
+		}
+		Wide wide = parseWide(text);
+		value = double(wide);
+		tail = double(wide - Wide(value));
+		exact = tail == 0 && math::exactly(text, value);
+	}
+	void compile(Compiler &compiler) override {
+		compiler.constant(value, tail, text, exact);
+	}
+};
+
+struct VariableNode : public ASTNode {
+	Symbol name;
+	VariableNode(Symbol n) : name(n) {}
+	void compile(Compiler &compiler) override {
+		compiler.load(name);
+	}
+};
+
+struct AssignmentNode : public ASTNode {
+	Symbol name;
+	ASTNode *value;
+	AssignmentNode(Symbol n, ASTNode *v) : name(n), value(v) {}
+	void compile(Compiler &compiler) override {
+		value->compile(compiler);
+		compiler.store(name, position);
+	}
+};
+
+struct FunctionCallNode : public ASTNode {
+	Symbol functionName;
+	std::vector<ASTNode *> arguments;
+	FunctionCallNode(Symbol name, std::vector<ASTNode *> args)
+		: functionName(name), arguments(std::move(args)) {}
+	void compile(Compiler &compiler) override {
+		if(functionName == Symbol("if") && arguments.size() == 3) {
+			arguments[0]->compile(compiler);
+			size_t otherwise = compiler.jump(OpCode::JUMPZ);
+			arguments[1]->compile(compiler);
+			size_t end = compiler.jump(OpCode::JUMP);
+			compiler.land(otherwise);
+			arguments[2]->compile(compiler);
+			compiler.land(end);
+			return;
+		}
+		auto builtin = functionName.builtin();
+		auto index = arguments.empty() ? nullptr : dynamic_cast<VariableNode *>(arguments[0]);
+		if(builtin && isReduction(builtin->op) && arguments.size() == 4 && index) {
+			arguments[1]->compile(compiler);
+			arguments[2]->compile(compiler);
+			size_t at = compiler.loop(builtin->op, index->name, 2);
+			arguments[3]->compile(compiler);
+			compiler.endLoop(at, 2);
+			return;
+		}
+		auto variable = arguments.size() == 4 ? dynamic_cast<VariableNode *>(arguments[1]) : nullptr;
+		if(builtin && (builtin->op == OpCode::INTEGRATE || builtin->op == OpCode::ROOT || builtin->op == OpCode::MINIMIZE) && variable) {
+			arguments[2]->compile(compiler);
+			arguments[3]->compile(compiler);
+			size_t at = compiler.loop(builtin->op, variable->name, 2);
+			arguments[0]->compile(compiler);
+			compiler.endLoop(at, 2);
+			return;
+		}
+		variable = arguments.size() == 2 ? dynamic_cast<VariableNode *>(arguments[1]) : nullptr;
+		if(builtin && builtin->op == OpCode::DIFF && variable) {
+			compiler.load(variable->name);
+			size_t at = compiler.loop(builtin->op, variable->name, 1);
+			arguments[0]->compile(compiler);
+			compiler.endLoop(at, 1);
+			return;
+		}
+		variable = arguments.size() == 3 ? dynamic_cast<VariableNode *>(arguments[1]) : nullptr;
+		if(builtin && builtin->op == OpCode::NEWTON && variable) {
+			arguments[2]->compile(compiler);
+			size_t at = compiler.loop(builtin->op, variable->name, 1);
+			arguments[0]->compile(compiler);
+			compiler.endLoop(at, 1);
+			return;
+		}
+		if(builtin && isReduction(builtin->op) && arguments.size() == 1) {
+			compiler.stage(Stage::REDUCE, builtin->op, arguments, position);
+			return;
+		}
+		if(auto function = functionName.stage()) {
+			if(arguments.size() < function->minArity || function->maxArity < arguments.size()) return compiler.fail("Wrong number of arguments: " + functionName.name(), position);
+			for(size_t k = 1; function->kind == Stage::GRAD && k < arguments.size(); k++) {
+				if(not dynamic_cast<VariableNode *>(arguments[k])) return compiler.fail("grad expects variables after the expression", arguments[k]->position);
+			}
+			compiler.stage(function->kind, OpCode::CONST, arguments, position);
+			return;
+		}
+		for(auto arg : arguments) arg->compile(compiler);
+		compiler.call(functionName, arguments.size(), position);
+	}
+};
+
+struct FunctionDefinitionNode : public ASTNode {
+	Symbol name;
+	std::vector<Symbol> params;
+	ASTNode *body;
+	FunctionDefinitionNode(Symbol n, std::vector<Symbol> ps, ASTNode *b)
+		: name(n), params(std::move(ps)), body(b) {}
+	void compile(Compiler &compiler) override {
+		compiler.fail("Function definition is only allowed at the top level: " + name.name(), position);
+	}
+	// Gives nullptr and sets failure when the definition does not compile.
+	std::shared_ptr<const Function> define(const Functions &functions, bool memo, Failure &failure) {
+		if(name.builtin() || name.stage() || name == Symbol("if")) {
+			failure = Failure{ "Cannot redefine builtin function: " + name.name(), position };
+			return nullptr;
+		}
+		auto function = std::make_shared<Function>();
+		function->name = name;
+		function->params = params;
+		if(params.size() <= MEMO_ARITY) {
+			function->body.memo = std::make_shared<Memo>();
+			function->body.memo->enabled = memo;
+		}
+		Compiler compiler(function->body, functions, name, params);
+		body->compile(compiler);
+		if(compiler.failure) {
+			failure = compiler.failure;
+			return nullptr;
+		}
+		if(not function->body.globals.empty() || draws(function->body)) function->body.memo = nullptr;
+		return function;
+	}
+};
+
+struct UnaryOpNode : public ASTNode {
+	TokenType op;
+	ASTNode *operand;
+	UnaryOpNode(TokenType o, ASTNode *expr) : op(o), operand(expr) {}
+	void compile(Compiler &compiler) override {
+		operand->compile(compiler);
+		switch(op) {
+			case TokenType::MINUS:
+				compiler.apply(OpCode::NEG, 1);
+				break;
+			default :
+				throw std::runtime_error("Invalid unary operator");
+		}
+	}
+};
+
+struct BinaryOpNode : public ASTNode {
+	TokenType op;
+	ASTNode *left, *right;
+	BinaryOpNode(TokenType o, ASTNode *l, ASTNode *r) : op(o), left(l), right(r) {}
+public:
+	void compile(Compiler &compiler) override {
+		left->compile(compiler);
+		right->compile(compiler);
+		switch(op) {
+			case TokenType::PLUS:
+				compiler.apply(OpCode::ADD, 2);
+				break;
+			case TokenType::MINUS:
+				compiler.apply(OpCode::SUB, 2);
+				break;
+			case TokenType::MULTIPLY:
+				compiler.apply(OpCode::MUL, 2);
+				break;
+			case TokenType::DIVIDE:
+				compiler.apply(OpCode::DIV, 2);
+				break;
+			case TokenType::LESS:
+				compiler.apply(OpCode::LT, 2);
+				break;
+			case TokenType::LESS_EQUAL:
+				compiler.apply(OpCode::LE, 2);
+				break;
+			case TokenType::GREATER:
+				compiler.apply(OpCode::GT, 2);
+				break;
+			case TokenType::GREATER_EQUAL:
+				compiler.apply(OpCode::GE, 2);
+				break;
+			case TokenType::EQUAL_EQUAL:
+				compiler.apply(OpCode::EQ, 2);
+				break;
+			case TokenType::NOT_EQUAL:
+				compiler.apply(OpCode::NE, 2);
+				break;
+			default:
+				throw std::runtime_error("Invalid operator");
+		}
+	}
+};
+
+// Reports a syntax error through failure instead of throwing, so that a script with
+// many bad lines costs no unwinding. Each parse function returns nullptr once it fails.
+// The parser owns every node it makes, so a tree lives as long as its parser and is
+// freed whole, also the parts built before a failure.
+class Parser {
+	Lexer lexer;
+	Token curtToken;
+	std::vector<std::unique_ptr<ASTNode>> nodes;
+	ASTNode *fail(const std::string &message) {
+		if(not failure) failure = Failure{ message, curtToken.position };
+		return nullptr;
+	}
+	ASTNode *unexpected() {
+		if(curtToken.type == TokenType::END) return fail("Unexpected end of input");
+		return fail((curtToken.type == TokenType::INVALID ? "Unexpected character: " : "Unexpected token: ") + curtToken.value);
+	}
+	bool consume(TokenType type) {
+		if(curtToken.type != type) {
+			unexpected();
+			return false;
+		}
+		curtToken = lexer.getNextToken();
+		return true;
+	}
+	template<class N>
+	N *at(N *node, size_t position) {
+		nodes.emplace_back(node);
+		node->position = position;
+		return node;
+	}
+	// Parses a parenthesized or bracketed list up to and including the closing token.
+	bool parseList(TokenType close, std::vector<ASTNode *> &items) {
+		if(curtToken.type != close) {
+			do {
+				ASTNode *item = parseExpression();
+				if(not item) return false;
+				items.push_back(item);
+				if(curtToken.type == TokenType::COMMA) { consume(TokenType::COMMA); }
+				else { break; }
+			} while(true);
+		}
+		return consume(close);
+	}
+public:
+	Failure failure;
+	Parser(const std::string &expr) : lexer(expr), curtToken(lexer.getNextToken()) {}
+	// A whole line: an expression followed by nothing else.
+	ASTNode *parse() {
+		ASTNode *node = parseExpression();
+		return node && curtToken.type != TokenType::END ? unexpected() : node;
+	}
+	ASTNode *parseExpression() {
+		ASTNode *node = parseSum();
+		while(node && (curtToken.type == TokenType::LESS || curtToken.type == TokenType::LESS_EQUAL
+			|| curtToken.type == TokenType::GREATER || curtToken.type == TokenType::GREATER_EQUAL
+			|| curtToken.type == TokenType::EQUAL_EQUAL || curtToken.type == TokenType::NOT_EQUAL)) {
+			TokenType op = curtToken.type;
+			size_t position = curtToken.position;
+			consume(op);
+			ASTNode *right = parseSum();
+			node = right ? at(new BinaryOpNode(op, node, right), position) : nullptr;
+		}
+		return node;
+	}
+	ASTNode *parseSum() {
+		ASTNode *node = parseTerm();
+		while(node && (curtToken.type ==  TokenType::PLUS || curtToken.type == TokenType::MINUS)) {
+			TokenType op = curtToken.type;
+			size_t position = curtToken.position;
+			consume(op);
+			ASTNode *right = parseTerm();
+			node = right ? at(new BinaryOpNode(op, node, right), position) : nullptr;
+		}
+		return node;
+	}
+	ASTNode *parseTerm() {
+		ASTNode *node = parseFactor();
+		while(node && (curtToken.type == TokenType::MULTIPLY || curtToken.type == TokenType::DIVIDE)) {
+			TokenType op = curtToken.type;
+			size_t position = curtToken.position;
+			consume(op);
+			ASTNode *right = parseFactor();
+			node = right ? at(new BinaryOpNode(op, node, right), position) : nullptr;
+		}
+		return node;
+	}
+	ASTNode *parseFactor() {
+		size_t position = curtToken.position;
+		if(curtToken.type == TokenType::MINUS) {
+			consume(TokenType::MINUS);
+			ASTNode *operand = parseFactor();
+			return operand ? at(new UnaryOpNode(TokenType::MINUS, operand), position) : nullptr;
+		}
+		if(curtToken.type == TokenType::NUMBER) {
+			std::string text = curtToken.value;
+			consume(TokenType::NUMBER);
+			return at(new NumberNode(text), position);
+		}
+		else if(curtToken.type == TokenType::IDENTIFIER) {
+			Symbol name(curtToken.value);
+			consume(TokenType::IDENTIFIER);
+			if(curtToken.type == TokenType::LPAREN) {
+				return parseFunctionCall(name, position);
+			}
+			else if(curtToken.type == TokenType::EQUAL) {
+				consume(TokenType::EQUAL);
+				ASTNode *value = parseExpression();
+				return value ? at(new AssignmentNode(name, value), position) : nullptr;
+			}
+			return at(new VariableNode(name), position);
+		}
+		else if(curtToken.type == TokenType::LPAREN) {
+			consume(TokenType::LPAREN);
+			ASTNode *node = parseExpression();
+			return node && consume(TokenType::RPAREN) ? node : nullptr;
+		}
+		else if(curtToken.type == TokenType::LBRACKET) {
+			consume(TokenType::LBRACKET);
+			std::vector<ASTNode *> elements;
+			if(not parseList(TokenType::RBRACKET, elements)) return nullptr;
+			return at(new ArrayNode(std::move(elements)), position);
+		}
+		return unexpected();
+	}
+	ASTNode *parseFunctionCall(Symbol funcName, size_t position) {
+		consume(TokenType::LPAREN);
+		std::vector<ASTNode *> args;
+		if(not parseList(TokenType::RPAREN, args)) return nullptr;
+		if(curtToken.type == TokenType::EQUAL) {
+			consume(TokenType::EQUAL);
+			std::vector<Symbol> params;
+			for(auto arg : args) {
+				auto param = dynamic_cast<VariableNode *>(arg);
+				if(not param || std::find(params.begin(), params.end(), param->name) != params.end()) {
+					curtToken.position = arg->position;
+					return fail("Invalid parameter in definition of " + funcName.name());
+				}
+				params.push_back(param->name);
+			}
+			ASTNode *body = parseExpression();
+			return body ? at(new FunctionDefinitionNode(funcName, params, body), position) : nullptr;
+		}
+		return at(new FunctionCallNode(funcName, args), position);
+	}
+};
+
+#endif
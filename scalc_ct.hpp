@@ -0,0 +1,435 @@
+// scalc_ct: scalc expressions parsed at compile time into inlined function objects.
+//
+//	auto hypot = SCALC_CT("f(x, y) = sqrt(x*x + y*y)");
+//	double r = hypot(3.0, 4.0);
+//
+// The source follows the grammar of scalc's Parser. It is read by constexpr functions
+// and turned into a type whose eval is plain inline code, so nothing is parsed or
+// dispatched at run time and a mistake in the expression is a compile error. A
+// definition's parameters are the function's arguments in order; a bare expression
+// takes none. Values are doubles, and a call whose expression uses only arithmetic,
+// comparisons and if is a constant expression. Header only, C++11.
+#ifndef SCALC_CT_HPP
+#define SCALC_CT_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace scalc {
+namespace ct {
+
+// Scanning, over the text of a source class at index i. Every function stops at the
+// terminating '\0', so none reads past the end.
+constexpr bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+constexpr bool isDigit(char c) { return '0' <= c && c <= '9'; }
+constexpr bool isAlpha(char c) { return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z'); }
+constexpr size_t skip(const char *s, size_t i) { return isSpace(s[i]) ? skip(s, i + 1) : i; }
+constexpr size_t name(const char *s, size_t i) { return isAlpha(s[i]) || isDigit(s[i]) || s[i] == '_' ? name(s, i + 1) : i; }
+constexpr size_t digits(const char *s, size_t i) { return isDigit(s[i]) || s[i] == '.' ? digits(s, i + 1) : i; }
+constexpr bool same(const char *s, size_t i, size_t end, const char *word) {
+	return i == end ? *word == '\0' : s[i] == *word && same(s, i + 1, end, word + 1);
+}
+constexpr bool same(const char *s, size_t i, size_t end, size_t j, size_t last) {
+	return end - i == last - j && (i == end || (s[i] == s[j] && same(s, i + 1, end, j + 1, last)));
+}
+
+// A literal is its digits without leading and trailing zeros times a power of ten. It
+// compiles when the digits fit in a double's mantissa and the power is at most 22
+// either way, the fast path of a correctly rounded parse: both are exact, so the one
+// multiplication or division rounds once. Other literals would need a full parse.
+constexpr size_t points(const char *s, size_t i, size_t end) { return i == end ? 0 : (s[i] == '.') + points(s, i + 1, end); }
+constexpr size_t decimals(const char *s, size_t i, size_t end) { return i == end ? 0 : s[i] == '.' ? end - i - 1 : decimals(s, i + 1, end); }
+constexpr size_t lead(const char *s, size_t i, size_t end) { return i < end && (s[i] == '0' || s[i] == '.') ? lead(s, i + 1, end) : i; }
+constexpr size_t trail(const char *s, size_t i, size_t end) { return i < end && (s[end - 1] == '0' || s[end - 1] == '.') ? trail(s, i, end - 1) : end; }
+constexpr size_t zeros(const char *s, size_t i, size_t end) { return i == end ? 0 : (s[i] == '0') + zeros(s, i + 1, end); }
+constexpr size_t figures(const char *s, size_t i, size_t end) { return i == end ? 0 : (s[i] != '.') + figures(s, i + 1, end); }
+constexpr uint64_t mantissa(const char *s, size_t i, size_t end, uint64_t m) {
+	return i == end ? m : mantissa(s, i + 1, end, s[i] == '.' ? m : m * 10 + uint64_t(s[i] - '0'));
+}
+constexpr int exponent(const char *s, size_t i, size_t end) { return int(zeros(s, trail(s, i, end), end)) - int(decimals(s, i, end)); }
+constexpr bool zero(const char *s, size_t i, size_t end) { return lead(s, i, end) >= trail(s, i, end); }
+constexpr bool exact(const char *s, size_t i, size_t end) {
+	return zero(s, i, end) || (figures(s, lead(s, i, end), trail(s, i, end)) <= 16
+		&& mantissa(s, lead(s, i, end), trail(s, i, end), 0) <= uint64_t(1) << 53 && -22 <= exponent(s, i, end) && exponent(s, i, end) <= 22);
+}
+constexpr double power(int n) { return n ? 10 * power(n - 1) : 1; }
+constexpr double number(const char *s, size_t i, size_t end) {
+	return zero(s, i, end) ? 0 : exponent(s, i, end) < 0 ? double(mantissa(s, lead(s, i, end), trail(s, i, end), 0)) / power(-exponent(s, i, end))
+		: double(mantissa(s, lead(s, i, end), trail(s, i, end), 0)) * power(exponent(s, i, end));
+}
+
+// A source that starts with name(a, b, ...) = is a definition. These find the ')' of
+// its parameter list, or 0, and where its body starts, or 0 for a bare expression.
+constexpr size_t close(const char *s, size_t i);
+constexpr size_t next(const char *s, size_t i) {
+	return s[i] == ')' ? i : s[i] == ',' && isAlpha(s[skip(s, i + 1)]) ? close(s, skip(s, i + 1)) : 0;
+}
+constexpr size_t close(const char *s, size_t i) { return s[i] == ')' ? i : isAlpha(s[i]) ? next(s, skip(s, name(s, i))) : 0; }
+constexpr size_t params(const char *s) { return skip(s, skip(s, name(s, skip(s, 0))) + 1); }
+constexpr size_t assign(const char *s, size_t i) { return s[i] == '=' && s[i + 1] != '=' ? i + 1 : 0; }
+constexpr size_t body(const char *s) {
+	return isAlpha(s[skip(s, 0)]) && s[skip(s, name(s, skip(s, 0)))] == '(' && close(s, params(s))
+		? assign(s, skip(s, close(s, params(s)) + 1)) : 0;
+}
+constexpr size_t count(const char *s, size_t p) {
+	return not isAlpha(s[p]) ? 0 : s[skip(s, name(s, p))] == ',' ? 1 + count(s, skip(s, skip(s, name(s, p)) + 1)) : 1;
+}
+constexpr size_t arity(const char *s) { return body(s) ? count(s, params(s)) : 0; }
+// The index of the parameter named s[i, end), or -1.
+constexpr int find(const char *s, size_t i, size_t end, size_t p, int k) {
+	return not isAlpha(s[p]) ? -1 : same(s, i, end, p, name(s, p)) ? k
+		: s[skip(s, name(s, p))] == ',' ? find(s, i, end, skip(s, skip(s, name(s, p)) + 1), k + 1) : -1;
+}
+constexpr int parameter(const char *s, size_t i, size_t end) { return body(s) ? find(s, i, end, params(s), 0) : -1; }
+
+template<class... T> struct Types {};
+template<size_t K, class List> struct At;
+template<class T, class... Rest> struct At<0, Types<T, Rest...>> { using type = T; };
+template<size_t K, class T, class... Rest> struct At<K, Types<T, Rest...>> : At<K - 1, Types<Rest...>> {};
+
+// The builtins of the calculator that work on single numbers.
+#define SCALC_CT_UNARY(X) \
+	X(Sin, "sin", std::sin(x)) \
+	X(Cos, "cos", std::cos(x)) \
+	X(Tan, "tan", std::tan(x)) \
+	X(Asin, "asin", std::asin(x)) \
+	X(Acos, "acos", std::acos(x)) \
+	X(Atan, "atan", std::atan(x)) \
+	X(Sinh, "sinh", std::sinh(x)) \
+	X(Cosh, "cosh", std::cosh(x)) \
+	X(Tanh, "tanh", std::tanh(x)) \
+	X(Asinh, "asinh", std::asinh(x)) \
+	X(Acosh, "acosh", std::acosh(x)) \
+	X(Atanh, "atanh", std::atanh(x)) \
+	X(Sqrt, "sqrt", std::sqrt(x)) \
+	X(Cbrt, "cbrt", std::cbrt(x)) \
+	X(Exp, "exp", std::exp(x)) \
+	X(Ln, "ln", std::log(x)) \
+	X(Log10, "log10", std::log10(x)) \
+	X(Log2, "log2", std::log2(x)) \
+	X(Abs, "abs", std::fabs(x)) \
+	X(Re, "re", x) \
+	X(Im, "im", ((void)x, 0.0)) \
+	X(Arg, "arg", x < 0 ? std::acos(-1.0) : x >= 0 ? 0.0 : x) \
+	X(Conj, "conj", x)
+
+#define SCALC_CT_BINARY(X) \
+	X(Log, "log", std::log(y) / std::log(x)) \
+	X(Pow, "pow", std::pow(x, y)) \
+	X(Mod, "mod", std::fmod(x, y))
+
+#define SCALC_CT_OPERATORS(X) \
+	X(Add, x + y) \
+	X(Sub, x - y) \
+	X(Mul, x * y) \
+	X(Div, x / y) \
+	X(Less, double(x < y)) \
+	X(LessEqual, double(x <= y)) \
+	X(Greater, double(x > y)) \
+	X(GreaterEqual, double(x >= y)) \
+	X(Equal, double(x == y)) \
+	X(NotEqual, double(x != y))
+
+// apply is a template so that it is constexpr where its body allows, such as for the
+// operators, re and conj, and an ordinary function for the cmath ones.
+#define SCALC_CT_FUNCTION1(type, text, value) struct type { template<class T> static constexpr double apply(T x) { return value; } };
+#define SCALC_CT_FUNCTION2(type, text, value) struct type { template<class T> static constexpr double apply(T x, T y) { return value; } };
+#define SCALC_CT_OPERATOR(type, value) SCALC_CT_FUNCTION2(type, "", value)
+#define SCALC_CT_NAME(type, text, value) text,
+#define SCALC_CT_TYPE(type, text, value) type,
+SCALC_CT_UNARY(SCALC_CT_FUNCTION1)
+SCALC_CT_BINARY(SCALC_CT_FUNCTION2)
+SCALC_CT_OPERATORS(SCALC_CT_OPERATOR)
+struct Negate { static constexpr double apply(double x) { return -x; } };
+
+constexpr const char *unaryNames[] = { SCALC_CT_UNARY(SCALC_CT_NAME) nullptr };
+constexpr const char *binaryNames[] = { SCALC_CT_BINARY(SCALC_CT_NAME) nullptr };
+using UnaryFunctions = Types<SCALC_CT_UNARY(SCALC_CT_TYPE) void>;
+using BinaryFunctions = Types<SCALC_CT_BINARY(SCALC_CT_TYPE) void>;
+using Additive = Types<void, Add, Sub>;
+using Multiplicative = Types<void, Mul, Div>;
+using Relations = Types<void, Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual>;
+
+// A function name as k for the kth unary builtin, 100 + k for the kth binary one,
+// 1000 for if, or -1.
+constexpr int lookup(const char *const *names, const char *s, size_t i, size_t end, int k) {
+	return names[k] == nullptr ? -1 : same(s, i, end, names[k]) ? k : lookup(names, s, i, end, k + 1);
+}
+constexpr int function(const char *s, size_t i, size_t end) {
+	return same(s, i, end, "if") ? 1000 : lookup(unaryNames, s, i, end, 0) >= 0 ? lookup(unaryNames, s, i, end, 0)
+		: lookup(binaryNames, s, i, end, 0) >= 0 ? 100 + lookup(binaryNames, s, i, end, 0) : -1;
+}
+
+// The nodes of a parsed expression. Each evaluates itself from the arguments.
+template<class S, size_t I, size_t End>
+struct Number {
+	static constexpr double value = number(S::text(), I, End);
+	template<size_t N> static constexpr double eval(const double (&)[N]) { return value; }
+};
+template<class S, size_t I, size_t End> constexpr double Number<S, I, End>::value;
+
+template<int K>
+struct Parameter {
+	template<size_t N> static constexpr double eval(const double (&args)[N]) { return args[K]; }
+};
+
+template<class F, class X>
+struct Unary {
+	template<size_t N> static constexpr double eval(const double (&args)[N]) { return F::apply(X::eval(args)); }
+};
+
+template<class F, class X, class Y>
+struct Binary {
+	template<size_t N> static constexpr double eval(const double (&args)[N]) { return F::apply(X::eval(args), Y::eval(args)); }
+};
+
+template<class C, class X, class Y>
+struct If {
+	template<size_t N> static constexpr double eval(const double (&args)[N]) { return C::eval(args) == 0 ? Y::eval(args) : X::eval(args); }
+};
+
+// Why and where, as an index into the source, an expression does not compile. The
+// compiler shows it as the argument of the Check that fails.
+struct syntax_error;
+struct undefined_variable;
+struct unknown_function;
+struct wrong_number_of_arguments;
+struct assignment_not_supported;
+struct inexact_literal;
+template<class Reason, size_t I>
+struct Error {
+	template<size_t N> static constexpr double eval(const double (&)[N]) { return 0; }
+};
+template<class Tree> struct Check : std::true_type {};
+template<class Reason, size_t I>
+struct Check<Error<Reason, I>> : std::false_type {
+	static_assert(I + 1 == 0, "scalc::ct: the expression does not compile; see Check<Error<reason, position>>");
+};
+
+// Node, or the first of the children that is an error.
+template<class Node, class... Children> struct Join { using type = Node; };
+template<class Node, class Reason, size_t I, class... Rest> struct Join<Node, Error<Reason, I>, Rest...> { using type = Error<Reason, I>; };
+template<class Node, class First, class... Rest> struct Join<Node, First, Rest...> : Join<Node, Rest...> {};
+
+// The parser. Each rule takes the source S and a position I after any spaces, and gives
+// the node as type and the position after it, again after any spaces, as end.
+template<class S, size_t I> struct Expression;
+
+enum Kind { MINUS, NUMBER, VARIABLE, CALL, ASSIGNMENT, PARENTHESES, INVALID };
+
+constexpr Kind kind(const char *s, size_t i) {
+	return s[i] == '-' ? MINUS : isDigit(s[i]) || s[i] == '.' ? NUMBER : s[i] == '(' ? PARENTHESES
+		: not isAlpha(s[i]) ? INVALID : s[skip(s, name(s, i))] == '(' ? CALL
+		: assign(s, skip(s, name(s, i))) ? ASSIGNMENT : VARIABLE;
+}
+
+template<class S, size_t I, Kind K = kind(S::text(), I)>
+struct Factor {
+	using type = Error<syntax_error, I>;
+	static constexpr size_t end = I;
+};
+
+template<class S, size_t I>
+struct Factor<S, I, ASSIGNMENT> {
+	using type = Error<assignment_not_supported, I>;
+	static constexpr size_t end = I;
+};
+
+template<class S, size_t I>
+struct Factor<S, I, MINUS> {
+	using operand = Factor<S, skip(S::text(), I + 1)>;
+	using type = typename Join<Unary<Negate, typename operand::type>, typename operand::type>::type;
+	static constexpr size_t end = operand::end;
+};
+
+template<class S, size_t I>
+struct Factor<S, I, NUMBER> {
+	static constexpr size_t last = digits(S::text(), I);
+	using type = typename std::conditional<points(S::text(), I, last) <= 1,
+		typename std::conditional<exact(S::text(), I, last), Number<S, I, last>, Error<inexact_literal, I>>::type, Error<syntax_error, I>>::type;
+	static constexpr size_t end = skip(S::text(), last);
+};
+
+template<class S, size_t I>
+struct Factor<S, I, VARIABLE> {
+	static constexpr int index = parameter(S::text(), I, name(S::text(), I));
+	using type = typename std::conditional<0 <= index, Parameter<index>, Error<undefined_variable, I>>::type;
+	static constexpr size_t end = skip(S::text(), name(S::text(), I));
+};
+
+template<class S, size_t I>
+struct Factor<S, I, PARENTHESES> {
+	using inner = Expression<S, skip(S::text(), I + 1)>;
+	using type = typename std::conditional<S::text()[inner::end] == ')', typename inner::type, Error<syntax_error, inner::end>>::type;
+	static constexpr size_t end = S::text()[inner::end] == ')' ? skip(S::text(), inner::end + 1) : inner::end;
+};
+
+// The arguments of a call from I, after the '(', up to and including the ')', as Types.
+template<class S, size_t I, class Done, char C = S::text()[I]>
+struct Rest {
+	using type = Error<syntax_error, I>;
+	static constexpr size_t end = I;
+};
+
+template<class S, size_t I, class... Done>
+struct Rest<S, I, Types<Done...>, ','> {
+	using item = Expression<S, skip(S::text(), I + 1)>;
+	using next = Rest<S, item::end, Types<Done..., typename item::type>>;
+	using type = typename Join<typename next::type, typename item::type>::type;
+	static constexpr size_t end = next::end;
+};
+
+template<class S, size_t I, class... Done>
+struct Rest<S, I, Types<Done...>, ')'> {
+	using type = Types<Done...>;
+	static constexpr size_t end = skip(S::text(), I + 1);
+};
+
+template<class S, size_t I, bool Empty = S::text()[I] == ')'>
+struct Arguments {
+	using first = Expression<S, I>;
+	using rest = Rest<S, first::end, Types<typename first::type>>;
+	using type = typename Join<typename rest::type, typename first::type>::type;
+	static constexpr size_t end = rest::end;
+};
+
+template<class S, size_t I>
+struct Arguments<S, I, true> {
+	using type = Types<>;
+	static constexpr size_t end = skip(S::text(), I + 1);
+};
+
+template<int Code, class Args, size_t I, int Group = Code < 0 ? 0 : Code < 100 ? 1 : Code < 1000 ? 2 : 3>
+struct Apply {
+	using type = Error<wrong_number_of_arguments, I>;
+};
+template<int Code, class Reason, size_t J, size_t I, int Group>
+struct Apply<Code, Error<Reason, J>, I, Group> {
+	using type = Error<Reason, J>;
+};
+template<int Code, class... A, size_t I>
+struct Apply<Code, Types<A...>, I, 0> {
+	using type = Error<unknown_function, I>;
+};
+template<int Code, class X, size_t I>
+struct Apply<Code, Types<X>, I, 1> {
+	using type = Unary<typename At<size_t(Code), UnaryFunctions>::type, X>;
+};
+template<int Code, class X, class Y, size_t I>
+struct Apply<Code, Types<X, Y>, I, 2> {
+	using type = Binary<typename At<size_t(Code - 100), BinaryFunctions>::type, X, Y>;
+};
+template<int Code, class C, class X, class Y, size_t I>
+struct Apply<Code, Types<C, X, Y>, I, 3> {
+	using type = If<C, X, Y>;
+};
+
+template<class S, size_t I>
+struct Factor<S, I, CALL> {
+	static constexpr size_t open = skip(S::text(), name(S::text(), I));
+	using arguments = Arguments<S, skip(S::text(), open + 1)>;
+	using type = typename Apply<function(S::text(), I, name(S::text(), I)), typename arguments::type, I>::type;
+	static constexpr size_t end = arguments::end;
+};
+
+// Left-associative chains of operators; Op indexes the level's operator list, 0 for none.
+template<class S, size_t I> struct Term;
+template<class S, size_t I> struct Sum;
+
+constexpr int additive(char c) { return c == '+' ? 1 : c == '-' ? 2 : 0; }
+constexpr int multiplicative(char c) { return c == '*' ? 1 : c == '/' ? 2 : 0; }
+constexpr int comparison(const char *s, size_t i) {
+	return s[i] == '<' ? (s[i + 1] == '=' ? 2 : 1) : s[i] == '>' ? (s[i + 1] == '=' ? 4 : 3)
+		: s[i] == '=' && s[i + 1] == '=' ? 5 : s[i] == '!' && s[i + 1] == '=' ? 6 : 0;
+}
+
+template<class Op, class L, class R>
+using Combine = typename Join<Binary<Op, L, R>, L, R>::type;
+
+template<class S, class L, size_t I, int Op = multiplicative(S::text()[I])>
+struct Terms {
+	using right = Factor<S, skip(S::text(), I + 1)>;
+	using next = Terms<S, Combine<typename At<Op, Multiplicative>::type, L, typename right::type>, right::end>;
+	using type = typename next::type;
+	static constexpr size_t end = next::end;
+};
+template<class S, class L, size_t I>
+struct Terms<S, L, I, 0> {
+	using type = L;
+	static constexpr size_t end = I;
+};
+
+template<class S, class L, size_t I, int Op = additive(S::text()[I])>
+struct Sums {
+	using right = Term<S, skip(S::text(), I + 1)>;
+	using next = Sums<S, Combine<typename At<Op, Additive>::type, L, typename right::type>, right::end>;
+	using type = typename next::type;
+	static constexpr size_t end = next::end;
+};
+template<class S, class L, size_t I>
+struct Sums<S, L, I, 0> {
+	using type = L;
+	static constexpr size_t end = I;
+};
+
+template<class S, class L, size_t I, int Op = comparison(S::text(), I)>
+struct Comparisons {
+	using right = Sum<S, skip(S::text(), I + (Op == 1 || Op == 3 ? 1 : 2))>;
+	using next = Comparisons<S, Combine<typename At<Op, Relations>::type, L, typename right::type>, right::end>;
+	using type = typename next::type;
+	static constexpr size_t end = next::end;
+};
+template<class S, class L, size_t I>
+struct Comparisons<S, L, I, 0> {
+	using type = L;
+	static constexpr size_t end = I;
+};
+
+template<class S, size_t I>
+struct Term : Terms<S, typename Factor<S, I>::type, Factor<S, I>::end> {};
+
+template<class S, size_t I>
+struct Sum : Sums<S, typename Term<S, I>::type, Term<S, I>::end> {};
+
+template<class S, size_t I>
+struct Expression : Comparisons<S, typename Sum<S, I>::type, Sum<S, I>::end> {};
+
+template<class S>
+struct Parse {
+	using expression = Expression<S, skip(S::text(), body(S::text()))>;
+	using type = typename std::conditional<S::text()[expression::end] == '\0', typename expression::type, Error<syntax_error, expression::end>>::type;
+};
+
+// The compiled expression, called with one number per parameter.
+template<class S>
+class Function {
+	using tree = typename Parse<S>::type;
+	static_assert(Check<tree>::value, "scalc::ct: the expression does not compile");
+public:
+	static constexpr size_t arity = ct::arity(S::text());
+	template<class... A>
+	constexpr double operator()(A... args) const {
+		static_assert(sizeof...(A) == arity, "scalc::ct: wrong number of arguments");
+		return tree::template eval<sizeof...(A) + 1>({ double(args)..., 0.0 });
+	}
+};
+
+#undef SCALC_CT_FUNCTION1
+#undef SCALC_CT_FUNCTION2
+#undef SCALC_CT_OPERATOR
+#undef SCALC_CT_NAME
+#undef SCALC_CT_TYPE
+
+}
+}
+
+// A scalc::ct::Function for the string literal source. The literal becomes the text of
+// a local class, which is how C++11 passes a string to a template.
+#define SCALC_CT(source) ([] { \
+	struct Source { static constexpr const char *text() { return source; } }; \
+	return ::scalc::ct::Function<Source>(); \
+}())
+
+#endif
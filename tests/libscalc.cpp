@@ -0,0 +1,35 @@
+// Prints what the library computes, for comparison with libscalc.out.
+#include <cstdio>
+#include <vector>
+#include "libscalc.h"
+
+int main() {
+	char error[64];
+	if(not scalc_compile("1 + )", error, sizeof error)) std::printf("compile: %s\n", error);
+	if(not scalc_compile("2^10", error, sizeof error)) std::printf("compile: %s\n", error);
+	scalc::Expression f("y = x * x + sum(i, 1, 10, i)");
+	scalc::Context context(f);
+	double x = 3, y = 0;
+	std::printf("bind: %d %d %d\n", context.bind("x", &x), context.bind("y", &y), context.bind("z", &x));
+	double value = context.eval();
+	std::printf("eval: %g %g\n", value, y);
+	std::vector<double> xs{ 0, 1, 2, 3 }, results(xs.size());
+	context.bind("x", xs.data());
+	context.bind("y", nullptr);
+	context.eval(xs.size(), results.data());
+	for(double result : results) std::printf("batch: %g\n", result);
+	scalc::Expression g("sum(grad(a * a * b, a, b)) + det([[a, 1], [2, 3]])");
+	scalc::Context matrix(g);
+	double a = 2, b = 5;
+	matrix.bind("a", &a);
+	matrix.bind("b", &b);
+	std::printf("stages: %g\n", matrix.eval());
+	scalc::Expression h("q + 1");
+	scalc::Context unbound(h);
+	try {
+		unbound.eval();
+	}
+	catch(const std::exception &e) {
+		std::printf("error: %s\n", e.what());
+	}
+}
@@ -0,0 +1,16 @@
+// Prints what compiled expressions compute, for comparison with scalc_ct.out.
+#include <cstdio>
+#include "scalc_ct.hpp"
+
+int main() {
+	auto hypot = SCALC_CT("f(x, y) = sqrt(x*x + y*y)");
+	auto step = SCALC_CT("f(x) = if(x < 2, x*3, -x) + pow(2, 3) - mod(7, 4)");
+	auto light = SCALC_CT("299792458.000000000000000");
+	auto tiny = SCALC_CT("0.1 + 0.0000000000000000000001 + 1000000000000000000000");
+	auto affine = SCALC_CT("f(x, y) = if(x < y, x*2.5 - 300, -y/0.1)");
+	constexpr double folded = decltype(affine)()(1.0, 2.0);
+	static_assert(folded == -297.5, "arithmetic is a constant expression");
+	std::printf("%.17g %.17g %.17g\n", hypot(3.0, 4.0), step(1.0), step(5.0));
+	std::printf("%.17g %.17g\n", light(), tiny());
+	std::printf("%.17g %.17g\n", folded, affine(3.0, 2.0));
+}